@@ -0,0 +1,76 @@
+#ifndef BENCH_WORDS_H_
+#define BENCH_WORDS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./hash_table/hash_table.h"
+#include "./file_to_buffer/fileToBuffer.h"
+#include "./hash_functions/hash_functions.h"
+
+// The word sets of lookup_bench and test_hashes.
+
+// Words in ht_gMaxWordLen-byte strides.
+struct WordSet {
+    char*  words;
+    size_t size;        // in bytes
+};
+
+
+// The words of a file, see ftbTransferBufferTo16. words is nullptr on failure.
+static void ReadWords(const char* file_name, WordSet* set) {
+    *set = {};
+
+    FILE* file = fopen(file_name, "r");
+    if (file == nullptr) {
+        return;
+    }
+
+    set->words = (char*) ftbTransferBufferTo16(&set->size, file);
+    fclose(file);
+}
+
+
+// The distinct words of the dictionary: the keys of a table built from it,
+// in the order of its buckets.
+static int GetDistinctWords(const WordSet* dict, WordSet* distinct) {
+    ht_HashTable ht = {};
+    if (ht_Contructor(&ht, 100003, HashCRC32_inline)) {
+        return -1;
+    }
+
+    if (ht_InsertParallel(&ht, dict->words, dict->size, 1)) {
+        ht_Destructor(&ht);
+        return -1;
+    }
+
+    size_t n_elems = ht_ListElems(&ht, nullptr);
+
+    ht_ElemRef* elems = (ht_ElemRef*) calloc(n_elems + 1, sizeof(ht_ElemRef));
+    distinct->words = (char*) calloc(n_elems + 1, ht_gMaxWordLen);
+
+    if (elems == nullptr || distinct->words == nullptr) {
+        free(elems);
+        ht_Destructor(&ht);
+        return -1;
+    }
+
+    ht_ListElems(&ht, elems);
+
+    // The words of the strides are at most ht_gMaxWordLen long, but a key
+    // must never spill into the next stride.
+    for (size_t i = 0; i < n_elems; i++) {
+        size_t len = elems[i].len < ht_gMaxWordLen ? elems[i].len : ht_gMaxWordLen;
+        memcpy(distinct->words + i * ht_gMaxWordLen, elems[i].key, len);
+    }
+
+    distinct->size = n_elems * ht_gMaxWordLen;
+
+    free(elems);
+    ht_Destructor(&ht);
+
+    return 0;
+}
+
+#endif // BENCH_WORDS_H_
@@ -0,0 +1,182 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "./hash_table/concurrent_table.h"
+#include "./file_to_buffer/fileToBuffer.h"
+#include "./hash_functions/hash_functions.h"
+
+
+const char gDictName[] = "dict.txt";
+
+const size_t gNumBuckets = 100000;
+const int    gNumRepeats = 20;
+const int    gMaxThreads = 64;
+
+struct WorkerArgs {
+    ct_ConcurrentTable* ct;
+    const char* c_dict;
+    size_t begin;
+    size_t end;
+    bool lookup;
+};
+
+static void* Worker(void* arg) {
+    WorkerArgs* args = (WorkerArgs*) arg;
+
+    for (int repeat = 0; repeat < gNumRepeats; repeat++) {
+        for (size_t pos = args->begin; pos < args->end; pos += ht_gMaxWordLen) {
+            const char* word = args->c_dict + pos;
+            size_t len = strnlen(word, ht_gMaxWordLen);
+
+            if (args->lookup) {
+                size_t value = 0;
+                ct_LookUp(args->ct, word, len, &value);
+            } else {
+                ct_Insert(args->ct, word, len);
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+
+static double GetTime() {
+    timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+// Splits the padded dictionary between n_threads workers and returns the wall time.
+static double RunWorkers(ct_ConcurrentTable* ct, const char* c_dict, size_t size,
+                         int n_threads, bool lookup) {
+    pthread_t  threads[gMaxThreads] = {};
+    WorkerArgs args   [gMaxThreads] = {};
+
+    size_t n_words = size / ht_gMaxWordLen;
+
+    double start = GetTime();
+
+    for (int i = 0; i < n_threads; i++) {
+        args[i] = {
+            .ct = ct,
+            .c_dict = c_dict,
+            .begin = n_words * (size_t) i       / (size_t) n_threads * ht_gMaxWordLen,
+            .end   = n_words * (size_t)(i + 1) / (size_t) n_threads * ht_gMaxWordLen,
+            .lookup = lookup,
+        };
+
+        pthread_create(&threads[i], nullptr, Worker, &args[i]);
+    }
+
+    for (int i = 0; i < n_threads; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+
+    return GetTime() - start;
+}
+
+
+int main() {
+    FILE* file = fopen(gDictName, "r");
+    if (file == nullptr) {
+        return -1;
+    }
+
+    size_t dict_size = 0;
+    char* c_dict = (char*) ftbTransferBufferTo16(&dict_size, file);
+    fclose(file);
+
+    if (c_dict == nullptr) {
+        return -1;
+    }
+
+    int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads > gMaxThreads) {
+        max_threads = gMaxThreads;
+    }
+
+    double n_ops = (double)(dict_size / ht_gMaxWordLen) * gNumRepeats;
+
+    printf("threads, insert Mops/s, lookup Mops/s, insert speedup, lookup speedup\n");
+
+    double base_insert = 0;
+    double base_lookup = 0;
+
+    // 1, 2, 4, ... and the number of cores last.
+    for (int n_threads = 1; ; n_threads = (n_threads * 2 < max_threads) ? n_threads * 2
+                                                                          : max_threads) {
+        ct_ConcurrentTable ct = {};
+        if (ct_Contructor(&ct, ct_gDefaultShards, gNumBuckets, HashCRC32_inline)) {
+            free(c_dict);
+            return -1;
+        }
+
+        double insert_time = RunWorkers(&ct, c_dict, dict_size, n_threads, false);
+        double lookup_time = RunWorkers(&ct, c_dict, dict_size, n_threads, true);
+
+        if (n_threads == 1) {
+            base_insert = insert_time;
+            base_lookup = lookup_time;
+        }
+
+        printf("%d, %.2lf, %.2lf, %.2lf, %.2lf\n", n_threads,
+               n_ops / insert_time * 1e-6, n_ops / lookup_time * 1e-6,
+               base_insert / insert_time, base_lookup / lookup_time);
+
+        ct_Destructor(&ct);
+
+        if (n_threads >= max_threads) {
+            break;
+        }
+    }
+
+    printf("\nthreads, ingest Mops/s, ingest speedup\n");
+
+    double base_ingest = 0;
+
+    for (int n_threads = 1; ; n_threads = (n_threads * 2 < max_threads) ? n_threads * 2
+                                                                          : max_threads) {
+        double ingest_time = 0;
+
+        for (int repeat = 0; repeat < gNumRepeats; repeat++) {
+            ht_HashTable ht = {};
+            if (ht_Contructor(&ht, gNumBuckets, HashCRC32_inline)) {
+                free(c_dict);
+                return -1;
+            }
+
+            double start = GetTime();
+            ht_Error err = ht_InsertParallel(&ht, c_dict, dict_size, n_threads);
+            ingest_time += GetTime() - start;
+
+            ht_Destructor(&ht);
+
+            if (err) {
+                free(c_dict);
+                return -1;
+            }
+        }
+
+        if (n_threads == 1) {
+            base_ingest = ingest_time;
+        }
+
+        printf("%d, %.2lf, %.2lf\n", n_threads, n_ops / ingest_time * 1e-6,
+               base_ingest / ingest_time);
+
+        if (n_threads >= max_threads) {
+            break;
+        }
+    }
+
+    free(c_dict);
+
+    return 0;
+}
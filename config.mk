@@ -13,11 +13,19 @@ CFLAGS = -O3 -Wall \
 -fstack-protector -fstrict-overflow \
 -fno-omit-frame-pointer \
 
-CFLAGS += -march=znver2
+# Baseline x86-64, the SSE4.2/AVX2/AVX-512 kernels are chosen at run time
+# (hash_functions/cpu_features.h). ARCH=native builds for this machine only.
+ARCH ?= x86-64
+CFLAGS += -march=$(ARCH)
 CFLAGS += -masm=intel
 
 CFLAGS += -D NDEBUG
 CFLAGS += -D NLOG
+
+# STATS=1 counts the probes of every lookup for ht_GetStats.
+ifeq ($(STATS), 1)
+CFLAGS += -D HT_STATS
+endif
 export CFLAGS
 
 export BUILD_DIR = ${CURDIR}/build
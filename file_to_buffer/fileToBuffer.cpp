@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <string.h>
 
@@ -59,27 +60,33 @@ void* ftbPutFileToBuffer(size_t* size, FILE* file)
 void* ftbTransferBufferTo16(size_t* size, FILE* file) 
 {
     size_t origSize = 0;
-    char* origBuffer = (char*) ftbPutFileToBuffer(&origSize, file);
+    const char* origBuffer = ftbMapFile(&origSize, file, FTB_MAP_SEQUENTIAL);
     if (origBuffer == nullptr)
     {
         return nullptr;
     }
 
-    char* newBuffer = (char*) calloc(origSize * 16, 1);
+    const char* origEnd = origBuffer + origSize;
+
+    // Slots for the words only, not for every byte of the file.
+    size_t nWords = 0;
+    for (const char* currentWord = origBuffer; currentWord < origEnd; nWords++)
+        currentWord += strnlen(currentWord, (size_t)(origEnd - currentWord)) + 1;
+
+    char* newBuffer = (char*) calloc(nWords * 16 + 1, 1);
     if (newBuffer == nullptr)
     {
-
-        free(origBuffer);
+        ftbUnmapFile(origBuffer, origSize);
         return nullptr;
     }
 
     size_t newBufferIndex = 0;
-    char* currentWord = origBuffer;
-    while (currentWord < origBuffer + origSize)
+    const char* currentWord = origBuffer;
+    while (currentWord < origEnd)
     {
-        size_t wordLength = strlen(currentWord);
+        size_t wordLength = strnlen(currentWord, (size_t)(origEnd - currentWord));
         
-        memcpy(newBuffer + newBufferIndex, currentWord, wordLength);
+        memcpy(newBuffer + newBufferIndex, currentWord, wordLength < 16 ? wordLength : 16);
         
         newBufferIndex += 16;
         
@@ -88,6 +95,232 @@ void* ftbTransferBufferTo16(size_t* size, FILE* file)
 
     *size = newBufferIndex;
 
-    free(origBuffer);
+    ftbUnmapFile(origBuffer, origSize);
     return newBuffer;
 }
+
+
+const char* ftbMapFile(size_t* size, FILE* file, int flags)
+{
+    struct stat bf = {};
+    if (fstat(fileno(file), &bf) == -1 || !S_ISREG(bf.st_mode))
+        return nullptr;
+
+    ssize_t fileSize = (ssize_t)bf.st_size;
+
+    // mmap can't map 0 bytes.
+    if (fileSize == 0)
+    {
+        *size = 0;
+        return "";
+    }
+
+    int mapFlags = MAP_PRIVATE;
+    if (flags & FTB_MAP_POPULATE)
+        mapFlags |= MAP_POPULATE;
+
+    void* buffer = mmap(nullptr, (size_t) fileSize, PROT_READ, mapFlags, fileno(file), 0);
+    if (buffer == MAP_FAILED)
+        return nullptr;
+
+    if (flags & FTB_MAP_SEQUENTIAL)
+        madvise(buffer, (size_t) fileSize, MADV_SEQUENTIAL);
+
+    if (flags & FTB_MAP_WILLNEED)
+        madvise(buffer, (size_t) fileSize, MADV_WILLNEED);
+
+    *size = (size_t) fileSize;
+
+    return (const char*) buffer;
+}
+
+
+void ftbUnmapFile(const char* buffer, size_t size)
+{
+    if (size == 0)
+        return;
+
+    munmap(const_cast<char*>(buffer), size);
+}
+
+
+// Makes room for the carried-over word and a chunk.
+static bool reserveStreamBuffer(ftbStreamBuffer* buffer, size_t size)
+{
+    if (buffer->capacity >= size)
+        return true;
+
+    char* data = (char*) realloc(buffer->data, size);
+    if (data == nullptr)
+        return false;
+
+    buffer->data     = data;
+    buffer->capacity = size;
+
+    return true;
+}
+
+
+// Reads until the buffer ends with a separator or the file ends.
+// Returns the number of bytes of the whole words, *total is all the bytes read.
+static size_t fillStreamBuffer(ftbStream* stream, ftbStreamBuffer* buffer,
+                               size_t* total, bool* eof, bool* failed)
+{
+    for (;;)
+    {
+        if (!reserveStreamBuffer(buffer, *total + stream->chunkSize))
+        {
+            *failed = true;
+            return 0;
+        }
+
+        size_t nRead = fread(buffer->data + *total, 1, stream->chunkSize, stream->file);
+        *total += nRead;
+
+        if (nRead < stream->chunkSize)
+        {
+            *eof    = true;
+            *failed = ferror(stream->file) != 0;
+            return *total;
+        }
+
+        size_t size = *total;
+        while (size > 0 && buffer->data[size - 1] != '\0')
+            size--;
+
+        if (size > 0)
+            return size;
+
+        // No separator at all: the word is longer than a chunk, read the rest of it.
+    }
+}
+
+
+static void* streamReader(void* arg)
+{
+    ftbStream* stream = (ftbStream*) arg;
+
+    const char* carry = nullptr;
+    size_t carrySize = 0;
+
+    for (int index = 0; ; index ^= 1)
+    {
+        ftbStreamBuffer* buffer = &stream->buffers[index];
+
+        pthread_mutex_lock(&stream->mutex);
+        while (buffer->full && !stream->stop)
+            pthread_cond_wait(&stream->cond, &stream->mutex);
+
+        bool stop = stream->stop;
+        pthread_mutex_unlock(&stream->mutex);
+
+        if (stop)
+            break;
+
+        bool eof    = false;
+        bool failed = false;
+        size_t total = carrySize;
+
+        // The caller reads only the whole words of the other buffer, the cut word is ours.
+        if (reserveStreamBuffer(buffer, carrySize + stream->chunkSize))
+            memcpy(buffer->data, carry, carrySize);
+        else
+            failed = true;
+
+        size_t size = failed ? 0 : fillStreamBuffer(stream, buffer, &total, &eof, &failed);
+
+        carry     = buffer->data + size;
+        carrySize = total - size;
+
+        pthread_mutex_lock(&stream->mutex);
+
+        buffer->size = size;
+        buffer->full = size > 0 && !failed;
+
+        stream->failed = failed;
+        stream->done   = eof || failed;
+
+        pthread_cond_broadcast(&stream->cond);
+        pthread_mutex_unlock(&stream->mutex);
+
+        if (eof || failed)
+            break;
+    }
+
+    return nullptr;
+}
+
+
+bool ftbStreamOpen(ftbStream* stream, FILE* file, size_t chunkSize)
+{
+    memset(stream, 0, sizeof(*stream));
+
+    stream->file      = file;
+    stream->chunkSize = chunkSize;
+    stream->current   = -1;
+
+    pthread_mutex_init(&stream->mutex, nullptr);
+    pthread_cond_init(&stream->cond, nullptr);
+
+    if (pthread_create(&stream->reader, nullptr, streamReader, stream))
+    {
+        pthread_mutex_destroy(&stream->mutex);
+        pthread_cond_destroy(&stream->cond);
+        return false;
+    }
+
+    return true;
+}
+
+
+const char* ftbStreamNext(ftbStream* stream, size_t* size)
+{
+    pthread_mutex_lock(&stream->mutex);
+
+    if (stream->current != -1)
+    {
+        stream->buffers[stream->current].full = false;
+        stream->current = -1;
+
+        pthread_cond_broadcast(&stream->cond);
+    }
+
+    ftbStreamBuffer* buffer = &stream->buffers[stream->next];
+
+    while (!buffer->full && !stream->done)
+        pthread_cond_wait(&stream->cond, &stream->mutex);
+
+    if (!buffer->full)
+    {
+        pthread_mutex_unlock(&stream->mutex);
+        return nullptr;
+    }
+
+    stream->current = stream->next;
+    stream->next ^= 1;
+
+    *size = buffer->size;
+
+    pthread_mutex_unlock(&stream->mutex);
+
+    return buffer->data;
+}
+
+
+bool ftbStreamClose(ftbStream* stream)
+{
+    pthread_mutex_lock(&stream->mutex);
+    stream->stop = true;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+
+    pthread_join(stream->reader, nullptr);
+
+    pthread_mutex_destroy(&stream->mutex);
+    pthread_cond_destroy(&stream->cond);
+
+    free(stream->buffers[0].data);
+    free(stream->buffers[1].data);
+
+    return !stream->failed;
+}
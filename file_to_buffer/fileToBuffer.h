@@ -2,6 +2,9 @@
 #define FILE_TO_BUFFER_H_
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 
 /**
  * @brief Puts the contents of a file into a buffer.
@@ -17,6 +20,180 @@
 void* ftbPutFileToBuffer(size_t* size, FILE* file);
 
 
+/**
+ * @brief Reads NUL-separated words of a file into 16-byte zero-padded slots.
+ *
+ * @param[out] size The size of the buffer in bytes, 16 per word.
+ * @param[in]  file A pointer to the file to be read.
+ *
+ * @return A pointer to the buffer, or NULL on failure.
+ *
+ * @note The buffer is allocated with calloc and must be freed by the caller.
+ * @note Words longer than 16 bytes are cut to 16.
+ */
 void* ftbTransferBufferTo16(size_t* size, FILE* file);
 
+
+enum ftbMapFlags
+{
+    FTB_MAP_DEFAULT    = 0,
+    FTB_MAP_POPULATE   = 1 << 0, // prefault all the pages while mapping (MAP_POPULATE)
+    FTB_MAP_SEQUENTIAL = 1 << 1, // madvise(MADV_SEQUENTIAL): aggressive readahead
+    FTB_MAP_WILLNEED   = 1 << 2, // madvise(MADV_WILLNEED): start reading right away
+};
+
+/**
+ * @brief Maps a file into memory read-only, nothing is copied.
+ *
+ * Only regular files can be mapped, read pipes with ftbStream.
+ *
+ * @param[out] size  The size of the file in bytes.
+ * @param[in]  file  A pointer to the file to be mapped.
+ * @param[in]  flags ftbMapFlags combined with |.
+ *
+ * @return A pointer to the mapping, or NULL on failure.
+ *
+ * @note The mapping must be released with ftbUnmapFile, it stays valid after fclose.
+ * @note The buffer is not null-terminated, use ftbNextWord to walk it.
+ */
+const char* ftbMapFile(size_t* size, FILE* file, int flags);
+
+void ftbUnmapFile(const char* buffer, size_t size);
+
+/**
+ * @brief Finds the next word of a buffer of NUL-separated words, in place.
+ *
+ * @param[in,out] pos    The current position, moved past the word.
+ * @param[in]     end    The end of the buffer.
+ * @param[out]    length The length of the word.
+ *
+ * @return A pointer to the word, or NULL if there are no words left.
+ *
+ * @note Empty words are skipped. The last word of a file may be not null-terminated.
+ */
+inline const char* ftbNextWord(const char** pos, const char* end, size_t* length)
+{
+    const char* word = *pos;
+
+    while (word < end && *word == '\0')
+        word++;
+
+    if (word >= end)
+    {
+        *pos = end;
+        return NULL;
+    }
+
+    *length = strnlen(word, (size_t)(end - word));
+    *pos = word + *length;
+
+    return word;
+}
+
+
+enum ftbTokenizeFlags
+{
+    FTB_TOKENIZE_DEFAULT   = 0,
+    FTB_TOKENIZE_CASE_FOLD = 1 << 0, // 'A'-'Z' are stored as 'a'-'z'
+};
+
+/**
+ * Words of a raw text in the layout ht_InsertParallel takes:
+ * 16 bytes per word, zero-padded, plus the length of every word.
+ */
+struct ftbWords
+{
+    char*    records;
+    uint8_t* lengths;   // at most 16, longer words are cut
+    size_t   count;
+    size_t   capacity;  // in words
+};
+
+/**
+ * @brief Splits raw text into words and appends them to words, in one pass.
+ *
+ * A word is a run of ASCII letters, digits and bytes >= 0x80 (so UTF-8
+ * letters stay whole), everything else separates words. The text is
+ * classified 64 bytes at a time with SIMD compares, word bounds are taken
+ * from the bit masks, so there is no strlen and no per-byte branch.
+ *
+ * @param[in,out] words The words found so far, zero-initialize it before the first call.
+ * @param[in]     text  The text, it doesn't have to be null-terminated.
+ * @param[in]     size  The size of the text in bytes.
+ * @param[in]     flags ftbTokenizeFlags combined with |.
+ *
+ * @return false if there is not enough memory, the words found before stay.
+ *
+ * @note A word cut by the end of the text is a word of its own,
+ *       pass whole texts or split them at separators.
+ */
+bool ftbTokenize(ftbWords* words, const char* text, size_t size, int flags);
+
+void ftbFreeWords(ftbWords* words);
+
+
+/**
+ * Reads a file of NUL-separated words (a pipe or stdin too) in fixed-size
+ * chunks on a separate thread. There are two buffers: while the caller
+ * processes one, the reader fills the other. A word cut by the end of a
+ * chunk is carried over to the next one, so every chunk holds whole words.
+ * Memory stays at two chunks plus the longest word, whatever the input size.
+ */
+struct ftbStreamBuffer
+{
+    char*  data;
+    size_t capacity;
+    size_t size;        // of the whole words, the cut word follows them
+    bool   full;        // owned by the caller until ftbStreamNext is called again
+};
+
+struct ftbStream
+{
+    FILE*  file;
+    size_t chunkSize;
+
+    ftbStreamBuffer buffers[2];
+    int next;           // the buffer the next chunk comes in
+    int current;        // the buffer the caller holds, -1 if none
+
+    bool done;          // the reader has published its last chunk
+    bool failed;
+    bool stop;          // set by ftbStreamClose
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t       reader;
+};
+
+const size_t FTB_DEFAULT_CHUNK_SIZE = 16 * 1024 * 1024;
+
+/**
+ * @brief Starts the reader thread.
+ *
+ * @param[out] stream    The stream to be initialized.
+ * @param[in]  file      A pointer to the file to be read, it's not closed by the stream.
+ * @param[in]  chunkSize The number of bytes read at once.
+ *
+ * @return false on failure.
+ */
+bool ftbStreamOpen(ftbStream* stream, FILE* file, size_t chunkSize);
+
+/**
+ * @brief Gives the previous chunk back to the reader and waits for the next one.
+ *
+ * @param[out] size The size of the chunk in bytes.
+ *
+ * @return A pointer to the chunk, or NULL at the end of the file or on a read error.
+ *
+ * @note Walk the chunk with ftbNextWord, the last word may be not null-terminated.
+ */
+const char* ftbStreamNext(ftbStream* stream, size_t* size);
+
+/**
+ * @brief Stops the reader thread and frees the buffers.
+ *
+ * @return false if reading the file has failed.
+ */
+bool ftbStreamClose(ftbStream* stream);
+
 #endif
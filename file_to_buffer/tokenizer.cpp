@@ -0,0 +1,196 @@
+#include "fileToBuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+
+// 16 bytes of 0xFF then 16 zeros: a load at kLengthMask + 16 - n keeps n bytes.
+alignas(32) static const unsigned char kLengthMask[32] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// The most words a 64-byte block can end.
+const size_t kMaxWordsPerBlock = 32;
+
+
+// Bit i is set if byte i is a letter, a digit or a byte >= 0x80.
+#ifdef __AVX2__
+static inline uint32_t classify32(const char* block)
+{
+    __m256i bytes = _mm256_loadu_si256((const __m256i*) block);
+
+    // c | 0x20 folds the case, letters are then in 'a'-'z'. Unsigned
+    // x <= 25 is min(x, 25) == x, there is no unsigned byte compare.
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)),
+                                     _mm256_set1_epi8('a'));
+    letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(25)), letter);
+
+    __m256i digit = _mm256_sub_epi8(bytes, _mm256_set1_epi8('0'));
+    digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+
+    __m256i high = _mm256_cmpgt_epi8(_mm256_setzero_si256(), bytes);
+
+    return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), high));
+}
+#else
+static inline uint32_t classify16(const char* block)
+{
+    __m128i bytes = _mm_loadu_si128((const __m128i*) block);
+
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(25)), letter);
+
+    __m128i digit = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+    digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+
+    __m128i high = _mm_cmplt_epi8(bytes, _mm_setzero_si128());
+
+    return (uint32_t) _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), high));
+}
+#endif
+
+
+static inline uint64_t classifyBlock(const char* block)
+{
+#ifdef __AVX2__
+    return (uint64_t) classify32(block) | (uint64_t) classify32(block + 32) << 32;
+#else
+    return (uint64_t) classify16(block)              | (uint64_t) classify16(block + 16) << 16 |
+           (uint64_t) classify16(block + 32) << 32   | (uint64_t) classify16(block + 48) << 48;
+#endif
+}
+
+
+static bool reserveWords(ftbWords* words, size_t count)
+{
+    if (words->capacity >= count)
+        return true;
+
+    size_t capacity = words->capacity ? words->capacity : 1024;
+    while (capacity < count)
+        capacity *= 2;
+
+    char* records = (char*) realloc(words->records, capacity * 16);
+    if (records == nullptr)
+        return false;
+
+    words->records = records;
+
+    uint8_t* lengths = (uint8_t*) realloc(words->lengths, capacity);
+    if (lengths == nullptr)
+        return false;
+
+    words->lengths  = lengths;
+    words->capacity = capacity;
+
+    return true;
+}
+
+
+// Room for the word is reserved by the caller.
+static inline void emitWord(ftbWords* words, const char* text, size_t size,
+                            size_t start, size_t length, int flags)
+{
+    size_t cut = length < 16 ? length : 16;
+
+    __m128i word;
+    if (size - start >= 16)
+    {
+        word = _mm_loadu_si128((const __m128i*)(text + start));
+    }
+    else
+    {
+        // The end of the text, don't read past it.
+        alignas(16) char tail[16] = {};
+        memcpy(tail, text + start, cut);
+        word = _mm_load_si128((const __m128i*) tail);
+    }
+
+    word = _mm_and_si128(word, _mm_loadu_si128((const __m128i*)(kLengthMask + 16 - cut)));
+
+    if (flags & FTB_TOKENIZE_CASE_FOLD)
+    {
+        __m128i upper = _mm_sub_epi8(word, _mm_set1_epi8('A'));
+        upper = _mm_cmpeq_epi8(_mm_min_epu8(upper, _mm_set1_epi8(25)), upper);
+
+        word = _mm_or_si128(word, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    }
+
+    _mm_storeu_si128((__m128i*)(words->records + words->count * 16), word);
+    words->lengths[words->count++] = (uint8_t) cut;
+}
+
+
+bool ftbTokenize(ftbWords* words, const char* text, size_t size, int flags)
+{
+    // About one word per 8 bytes of text, grown if it's more.
+    if (!reserveWords(words, words->count + size / 8 + kMaxWordsPerBlock))
+        return false;
+
+    size_t wordStart = 0;
+    uint64_t open = 0;  // the previous block ends inside a word
+
+    for (size_t pos = 0; pos < size; pos += 64)
+    {
+        uint64_t mask = 0;
+        if (size - pos >= 64)
+        {
+            mask = classifyBlock(text + pos);
+        }
+        else
+        {
+            // Zeros are separators, so the last word ends inside the block.
+            alignas(32) char tail[64] = {};
+            memcpy(tail, text + pos, size - pos);
+            mask = classifyBlock(tail);
+        }
+
+        if (!reserveWords(words, words->count + kMaxWordsPerBlock + 1))
+            return false;
+
+        uint64_t shifted = mask << 1 | open;
+        uint64_t starts  = mask & ~shifted;
+        uint64_t ends    = ~mask & shifted;
+
+        // The first end may close the word of the previous block,
+        // the rest pair up with the starts in order.
+        if (open && ends)
+        {
+            size_t end = pos + (size_t) __builtin_ctzll(ends);
+            emitWord(words, text, size, wordStart, end - wordStart, flags);
+            ends &= ends - 1;
+        }
+
+        while (ends)
+        {
+            size_t start = (size_t) __builtin_ctzll(starts);
+            size_t end   = (size_t) __builtin_ctzll(ends);
+            emitWord(words, text, size, pos + start, end - start, flags);
+
+            starts &= starts - 1;
+            ends   &= ends - 1;
+        }
+
+        if (starts)
+            wordStart = pos + (size_t) __builtin_ctzll(starts);
+
+        open = mask >> 63;
+    }
+
+    if (open)
+        emitWord(words, text, size, wordStart, size - wordStart, flags);
+
+    return true;
+}
+
+
+void ftbFreeWords(ftbWords* words)
+{
+    free(words->records);
+    free(words->lengths);
+
+    memset(words, 0, sizeof(*words));
+}
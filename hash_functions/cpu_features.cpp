@@ -0,0 +1,55 @@
+#include "cpu_features.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+cpu_Level cpu_gLevel  = CPU_LEVEL_UNKNOWN;
+bool      cpu_gHasAES = false;
+
+static const char* const cpu_gLevelNames[] = {"unknown", "scalar", "sse4.2", "avx2", "avx512"};
+
+
+static cpu_Level cpu_GetSupportedLevel() {
+    __builtin_cpu_init();
+
+    // The AVX checks include the OS support of the wider registers.
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return CPU_LEVEL_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return CPU_LEVEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return CPU_LEVEL_SSE42;
+    }
+
+    return CPU_LEVEL_SCALAR;
+}
+
+
+// Threads racing here all store the same level.
+cpu_Level cpu_DetectLevel() {
+    cpu_Level level = cpu_GetSupportedLevel();
+
+    const char* limit = getenv("HT_CPU_LEVEL");
+
+    for (int i = CPU_LEVEL_SCALAR; limit && i < (int) level; i++) {
+        if (strcmp(limit, cpu_gLevelNames[i]) == 0) {
+            level = (cpu_Level) i;
+        }
+    }
+
+    __atomic_store_n(&cpu_gHasAES, __builtin_cpu_supports("aes") != 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&cpu_gLevel, level, __ATOMIC_RELAXED);
+
+    return level;
+}
+
+
+const char* cpu_GetLevelName(cpu_Level level) {
+    if ((size_t) level >= sizeof(cpu_gLevelNames) / sizeof(cpu_gLevelNames[0])) {
+        return cpu_gLevelNames[CPU_LEVEL_UNKNOWN];
+    }
+
+    return cpu_gLevelNames[level];
+}
@@ -0,0 +1,45 @@
+#ifndef CPU_FEATURES_H_
+#define CPU_FEATURES_H_
+
+// The build targets baseline x86-64, the hash and key compare kernels are
+// compiled for several instruction sets and chosen by the level of the CPU
+// the program runs on. The level is detected on the first call, after that
+// a kernel costs one predictable branch.
+//
+// HT_CPU_LEVEL=scalar|sse4.2|avx2|avx512 in the environment lowers it,
+// to measure or test the other kernels on one machine.
+
+// Each level includes the previous ones.
+enum cpu_Level
+{
+    CPU_LEVEL_UNKNOWN,  // not detected yet
+    CPU_LEVEL_SCALAR,   // baseline x86-64: table CRC32, SSE2 compares
+    CPU_LEVEL_SSE42,    // crc32 and ptest
+    CPU_LEVEL_AVX2,
+    CPU_LEVEL_AVX512,   // F and BW
+};
+
+extern cpu_Level cpu_gLevel;
+extern bool      cpu_gHasAES;
+
+cpu_Level   cpu_DetectLevel();
+const char* cpu_GetLevelName(cpu_Level level);
+
+inline cpu_Level cpu_GetLevel() {
+    cpu_Level level = __atomic_load_n(&cpu_gLevel, __ATOMIC_RELAXED);
+
+    if (__builtin_expect(level == CPU_LEVEL_UNKNOWN, 0)) {
+        level = cpu_DetectLevel();
+    }
+
+    return level;
+}
+
+// AES-NI isn't part of any level, some SSE4.2 and AVX2 CPUs lack it. It's
+// used from SSE42 up. A stale false only picks the table version of a
+// kernel, which gives the same hashes.
+inline bool cpu_HasAES() {
+    return cpu_GetLevel() >= CPU_LEVEL_SSE42 && __atomic_load_n(&cpu_gHasAES, __ATOMIC_RELAXED);
+}
+
+#endif
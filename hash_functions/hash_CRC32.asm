@@ -1,7 +1,10 @@
-global HashCRC32_asm
+global HashCRC32_asm_sse42
+
+extern HashCRC32_long
 
 ;;==============================================================================
-;; HashCRC32 - optimized hash function, handles only up to 16 symbols
+;; HashCRC32_asm_sse42 - optimized hash function, needs SSE4.2. HashCRC32_asm
+;; in hash_functions.cpp calls it if the CPU has it and takes longer strings.
 ;;
 ;; Input:
 ;;      rdi - string
@@ -11,7 +14,9 @@ global HashCRC32_asm
 ;;      rax - hash
 ;;
 ;;==============================================================================
-HashCRC32_asm:
+HashCRC32_asm_sse42:
+        cmp     rsi, 16
+        ja      HashCRC32_long
         mov eax, 0xDEADDEAD
         jmp      [.table + rsi*8]
 .table:
@@ -0,0 +1,196 @@
+#include "hash_functions.h"
+#include <immintrin.h>
+
+// AES hash: three aesenc rounds over the zero-padded 16-byte key, so all
+// 64 bits of the hash are mixed, where CRC32 gives only 32. Two rounds make
+// every output byte depend on every input byte, but the S-boxes of the
+// second round see one column of the key each. Keys that share a prefix,
+// like user1000037, then flip some output bits 80% of the time. Longer keys
+// take one round per 16-byte block and the three rounds at the end.
+//
+// Without AES-NI the rounds are computed with the S-box, bit for bit the
+// same as aesenc.
+
+struct AesBlock {
+    uint64_t lo;
+    uint64_t hi;
+};
+
+// Round keys, from the digits of pi.
+const AesBlock kAesKeys[4] = {
+    {0x243F6A8885A308D3, 0x13198A2E03707344},
+    {0xA4093822299F31D0, 0x082EFA98EC4E6C89},
+    {0x452821E638D01377, 0xBE5466CF34E90C6C},
+    {0xC0AC29B7C97C50DD, 0x3F84D5B5B5470917},
+};
+
+struct AesSBox {
+    uint8_t entries[256];
+};
+
+inline static constexpr uint8_t AesRotl(uint8_t byte, int shift) {
+    return (uint8_t)((byte << shift) | (byte >> (8 - shift)));
+}
+
+// 3 generates the multiplicative group of GF(2^8), so the inverse of 3^i
+// is 3^(255 - i). Then the affine map.
+static constexpr AesSBox MakeAesSBox() {
+    uint8_t power[255] = {};
+    uint8_t log[256]   = {};
+
+    uint8_t x = 1;
+    for (int i = 0; i < 255; i++) {
+        power[i] = x;
+        log[x]   = (uint8_t) i;
+
+        x ^= (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1B : 0));
+    }
+
+    AesSBox sbox = {};
+
+    for (int byte = 0; byte < 256; byte++) {
+        uint8_t inverse = (byte == 0) ? 0 : power[(255 - log[byte]) % 255];
+
+        sbox.entries[byte] = (uint8_t)(inverse ^ AesRotl(inverse, 1) ^ AesRotl(inverse, 2) ^
+                                       AesRotl(inverse, 3) ^ AesRotl(inverse, 4) ^ 0x63);
+    }
+
+    return sbox;
+}
+
+static constexpr AesSBox kAesSBox = MakeAesSBox();
+
+inline static uint8_t AesDouble(uint8_t byte) {
+    return (uint8_t)((byte << 1) ^ ((byte & 0x80) ? 0x1B : 0));
+}
+
+// aesenc: ShiftRows, SubBytes, MixColumns, then the round key. Byte i of
+// the block is row i % 4 of column i / 4.
+static AesBlock AesEncRound(AesBlock block, AesBlock key) {
+    uint8_t state[16] = {};
+    memcpy(state, &block, sizeof(state));
+
+    uint8_t sub[16] = {};
+    for (int i = 0; i < 16; i++) {
+        int row = i % 4;
+        int col = i / 4;
+
+        sub[i] = kAesSBox.entries[state[row + 4 * ((col + row) % 4)]];
+    }
+
+    for (int col = 0; col < 16; col += 4) {
+        uint8_t a0 = sub[col + 0];
+        uint8_t a1 = sub[col + 1];
+        uint8_t a2 = sub[col + 2];
+        uint8_t a3 = sub[col + 3];
+        uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+
+        // 2a0 ^ 3a1 ^ a2 ^ a3 = a0 ^ all ^ 2(a0 ^ a1), and so on.
+        state[col + 0] = a0 ^ all ^ AesDouble(a0 ^ a1);
+        state[col + 1] = a1 ^ all ^ AesDouble(a1 ^ a2);
+        state[col + 2] = a2 ^ all ^ AesDouble(a2 ^ a3);
+        state[col + 3] = a3 ^ all ^ AesDouble(a3 ^ a0);
+    }
+
+    memcpy(&block, state, sizeof(state));
+
+    block.lo ^= key.lo;
+    block.hi ^= key.hi;
+
+    return block;
+}
+
+
+static uint64_t HashAES_scalar(const void* mem, size_t size, AesBlock first_key) {
+    const char* c_mem = (const char*)mem;
+    AesBlock state = first_key;
+
+    if (size <= 16) {
+        uint64_t chunks[2] = {};
+        HashLoad16(c_mem, size, chunks);
+
+        state.lo ^= chunks[0];
+        state.hi ^= chunks[1];
+    } else {
+        state.lo ^= size;
+
+        for (size_t pos = 0; pos < size; pos += 16) {
+            uint64_t chunks[2] = {};
+            HashLoad16(c_mem + pos, (size - pos < 16) ? size - pos : 16, chunks);
+
+            state.lo ^= chunks[0];
+            state.hi ^= chunks[1];
+            state = AesEncRound(state, kAesKeys[1]);
+        }
+    }
+
+    state = AesEncRound(state, kAesKeys[1]);
+    state = AesEncRound(state, kAesKeys[2]);
+    state = AesEncRound(state, kAesKeys[3]);
+
+    return state.lo ^ state.hi;
+}
+
+
+__attribute__((target("aes")))
+static uint64_t HashAES_aesni(const void* mem, size_t size, AesBlock first_key) {
+    const char* c_mem = (const char*)mem;
+    const __m128i key1 = _mm_set_epi64x((int64_t) kAesKeys[1].hi, (int64_t) kAesKeys[1].lo);
+    const __m128i key2 = _mm_set_epi64x((int64_t) kAesKeys[2].hi, (int64_t) kAesKeys[2].lo);
+    const __m128i key3 = _mm_set_epi64x((int64_t) kAesKeys[3].hi, (int64_t) kAesKeys[3].lo);
+
+    __m128i state = _mm_set_epi64x((int64_t) first_key.hi, (int64_t) first_key.lo);
+
+    if (size <= 16) {
+        uint64_t chunks[2] = {};
+        HashLoad16(c_mem, size, chunks);
+
+        state = _mm_xor_si128(state, _mm_set_epi64x((int64_t) chunks[1], (int64_t) chunks[0]));
+    } else {
+        state = _mm_xor_si128(state, _mm_cvtsi64_si128((int64_t) size));
+
+        size_t pos = 0;
+        for (; pos + 16 <= size; pos += 16) {
+            state = _mm_xor_si128(state, _mm_loadu_si128((const __m128i*)(c_mem + pos)));
+            state = _mm_aesenc_si128(state, key1);
+        }
+
+        if (pos < size) {
+            uint64_t chunks[2] = {};
+            HashLoad16(c_mem + pos, size - pos, chunks);
+
+            state = _mm_xor_si128(state, _mm_set_epi64x((int64_t) chunks[1], (int64_t) chunks[0]));
+            state = _mm_aesenc_si128(state, key1);
+        }
+    }
+
+    state = _mm_aesenc_si128(state, key1);
+    state = _mm_aesenc_si128(state, key2);
+    state = _mm_aesenc_si128(state, key3);
+
+    return (uint64_t) _mm_cvtsi128_si64(_mm_xor_si128(state, _mm_unpackhi_epi64(state, state)));
+}
+
+
+uint64_t HashAES(const void* mem, size_t size) {
+    if (!cpu_HasAES()) {
+        return HashAES_scalar(mem, size, kAesKeys[0]);
+    }
+
+    return HashAES_aesni(mem, size, kAesKeys[0]);
+}
+
+
+// The seed goes into the first key, the rounds keep their keys.
+uint64_t HashAES_Seeded(const void* mem, size_t size, uint64_t seed) {
+    AesBlock first_key = {
+        kAesKeys[0].lo ^ seed,
+        kAesKeys[0].hi ^ (seed * 0x9E3779B97F4A7C15ull),
+    };
+
+    if (!cpu_HasAES()) {
+        return HashAES_scalar(mem, size, first_key);
+    }
+
+    return HashAES_aesni(mem, size, first_key);
+}
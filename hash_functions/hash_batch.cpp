@@ -0,0 +1,289 @@
+#include "hash_functions.h"
+#include <immintrin.h>
+
+// Batch kernels hash many keys at once. A single key is latency-bound:
+// crc32 takes 3 cycles and the two of a key depend on each other. Several
+// keys give independent chains, and the vector lanes of MulXor.
+//
+// Keys are staged in zero-padded 16-byte records, the layout of
+// ftbTransferBufferTo16 and ftbTokenize. A record gives the same hash as
+// its key, since the hashes of short keys pad them with zeros anyway.
+
+const size_t kRecordSize = 16;
+const size_t kStagedKeys = 16;
+
+// MulXor: NH over the four 32-bit words of a record, two 32x32->64
+// multiplies, then a mixer with two more. There are only 32-bit
+// multiplies, so AVX2 and AVX-512 hash a key per 64-bit lane with vpmuludq.
+const uint32_t kMulXorKeys[4] = {0x9E3779B9, 0x7F4A7C15, 0x85EBCA6B, 0xC2B2AE35};
+const uint32_t kMulXorMix[2]  = {0x2545F491, 0x9FB21C65};
+
+inline static uint64_t MulXorBlock(const uint64_t chunks[2], const uint32_t keys[4]) {
+    uint64_t a = (uint64_t)(uint32_t)((uint32_t) chunks[0] + keys[0]) *
+                 (uint32_t)((uint32_t)(chunks[0] >> 32) + keys[1]);
+    uint64_t b = (uint64_t)(uint32_t)((uint32_t) chunks[1] + keys[2]) *
+                 (uint32_t)((uint32_t)(chunks[1] >> 32) + keys[3]);
+
+    return a + b;
+}
+
+
+inline static uint64_t MulXorMix(uint64_t x) {
+    x ^= x >> 29;
+
+    uint64_t y = (x & 0xFFFFFFFF) * kMulXorMix[0] + (x >> 32) * kMulXorMix[1];
+
+    return y ^ (y >> 32);
+}
+
+
+// Keys longer than a record are chained block by block, on the scalar path only.
+inline static uint64_t MulXorKeyed(const void* mem, size_t size, const uint32_t keys[4],
+                                   uint64_t seed) {
+    const char* c_mem = (const char*)mem;
+    uint64_t chunks[2] = {};
+
+    if (size <= kRecordSize) {
+        HashLoad16(c_mem, size, chunks);
+        return MulXorMix(MulXorBlock(chunks, keys));
+    }
+
+    uint64_t hash = size ^ seed;
+
+    for (size_t pos = 0; pos < size; pos += kRecordSize) {
+        size_t len = (size - pos < kRecordSize) ? size - pos : kRecordSize;
+
+        HashLoad16(c_mem + pos, len, chunks);
+        hash = (hash ^ MulXorBlock(chunks, keys)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    return MulXorMix(hash);
+}
+
+
+uint64_t HashMulXor(const void* mem, size_t size) {
+    return MulXorKeyed(mem, size, kMulXorKeys, 0);
+}
+
+
+// NH with random keys is universal: two keys collide with a probability
+// of about 2^-32 whatever they are. The seed makes the keys.
+uint64_t HashMulXor_Seeded(const void* mem, size_t size, uint64_t seed) {
+    uint64_t spread = seed * 0x9E3779B97F4A7C15ull;
+
+    const uint32_t keys[4] = {
+        kMulXorKeys[0] + (uint32_t) seed,   kMulXorKeys[1] + (uint32_t)(seed >> 32),
+        kMulXorKeys[2] + (uint32_t) spread, kMulXorKeys[3] + (uint32_t)(spread >> 32),
+    };
+
+    return MulXorKeyed(mem, size, keys, seed);
+}
+
+
+// Four chains at once, crc32 issues one per cycle.
+__attribute__((target("sse4.2")))
+static void HashCRC32_Padded_sse42(const char* records, size_t count, uint64_t* hashes) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        uint64_t chunks[8] = {};
+        memcpy(chunks, records + i * kRecordSize, sizeof(chunks));
+
+        uint64_t h0 = _mm_crc32_u64(0, chunks[0]);
+        uint64_t h1 = _mm_crc32_u64(0, chunks[2]);
+        uint64_t h2 = _mm_crc32_u64(0, chunks[4]);
+        uint64_t h3 = _mm_crc32_u64(0, chunks[6]);
+
+        hashes[i + 0] = _mm_crc32_u64(h0, chunks[1]);
+        hashes[i + 1] = _mm_crc32_u64(h1, chunks[3]);
+        hashes[i + 2] = _mm_crc32_u64(h2, chunks[5]);
+        hashes[i + 3] = _mm_crc32_u64(h3, chunks[7]);
+    }
+
+    for (; i < count; i++) {
+        uint64_t chunks[2] = {};
+        memcpy(chunks, records + i * kRecordSize, sizeof(chunks));
+
+        hashes[i] = _mm_crc32_u64(_mm_crc32_u64(0, chunks[0]), chunks[1]);
+    }
+}
+
+
+void HashCRC32_Padded(const char* records, size_t count, uint64_t* hashes) {
+    if (cpu_GetLevel() < CPU_LEVEL_SSE42) {
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = HashCRC32_16_scalar(records + i * kRecordSize, kRecordSize);
+        }
+
+        return;
+    }
+
+    HashCRC32_Padded_sse42(records, count, hashes);
+}
+
+
+// Keys [0, 2, 1, 3] end up in the lanes, the last permute puts them in order.
+__attribute__((target("avx2")))
+static void HashMulXor_Padded_avx2(const char* records, size_t count, uint64_t* hashes) {
+    const __m256i keys_lo = _mm256_set1_epi64x((int64_t)((uint64_t) kMulXorKeys[1] << 32 |
+                                                         kMulXorKeys[0]));
+    const __m256i keys_hi = _mm256_set1_epi64x((int64_t)((uint64_t) kMulXorKeys[3] << 32 |
+                                                         kMulXorKeys[2]));
+    const __m256i mix_lo  = _mm256_set1_epi64x(kMulXorMix[0]);
+    const __m256i mix_hi  = _mm256_set1_epi64x(kMulXorMix[1]);
+
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(records + i * kRecordSize));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(records + i * kRecordSize + 32));
+
+        __m256i lo = _mm256_add_epi32(_mm256_unpacklo_epi64(r0, r1), keys_lo);
+        __m256i hi = _mm256_add_epi32(_mm256_unpackhi_epi64(r0, r1), keys_hi);
+
+        __m256i x = _mm256_add_epi64(_mm256_mul_epu32(lo, _mm256_srli_epi64(lo, 32)),
+                                     _mm256_mul_epu32(hi, _mm256_srli_epi64(hi, 32)));
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 29));
+
+        __m256i y = _mm256_add_epi64(_mm256_mul_epu32(x, mix_lo),
+                                     _mm256_mul_epu32(_mm256_srli_epi64(x, 32), mix_hi));
+        y = _mm256_xor_si256(y, _mm256_srli_epi64(y, 32));
+
+        _mm256_storeu_si256((__m256i*)(hashes + i), _mm256_permute4x64_epi64(y, 0xD8));
+    }
+
+    for (; i < count; i++) {
+        hashes[i] = HashMulXor(records + i * kRecordSize, kRecordSize);
+    }
+}
+
+
+// Keys [0, 4, 1, 5, 2, 6, 3, 7] end up in the lanes.
+__attribute__((target("avx512f")))
+static void HashMulXor_Padded_avx512(const char* records, size_t count, uint64_t* hashes) {
+    const __m512i keys_lo = _mm512_set1_epi64((int64_t)((uint64_t) kMulXorKeys[1] << 32 |
+                                                        kMulXorKeys[0]));
+    const __m512i keys_hi = _mm512_set1_epi64((int64_t)((uint64_t) kMulXorKeys[3] << 32 |
+                                                        kMulXorKeys[2]));
+    const __m512i mix_lo  = _mm512_set1_epi64(kMulXorMix[0]);
+    const __m512i mix_hi  = _mm512_set1_epi64(kMulXorMix[1]);
+    const __m512i order   = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m512i r0 = _mm512_loadu_si512(records + i * kRecordSize);
+        __m512i r1 = _mm512_loadu_si512(records + i * kRecordSize + 64);
+
+        __m512i lo = _mm512_add_epi32(_mm512_unpacklo_epi64(r0, r1), keys_lo);
+        __m512i hi = _mm512_add_epi32(_mm512_unpackhi_epi64(r0, r1), keys_hi);
+
+        __m512i x = _mm512_add_epi64(_mm512_mul_epu32(lo, _mm512_srli_epi64(lo, 32)),
+                                     _mm512_mul_epu32(hi, _mm512_srli_epi64(hi, 32)));
+        x = _mm512_xor_si512(x, _mm512_srli_epi64(x, 29));
+
+        __m512i y = _mm512_add_epi64(_mm512_mul_epu32(x, mix_lo),
+                                     _mm512_mul_epu32(_mm512_srli_epi64(x, 32), mix_hi));
+        y = _mm512_xor_si512(y, _mm512_srli_epi64(y, 32));
+
+        _mm512_storeu_si512(hashes + i, _mm512_permutexvar_epi64(order, y));
+    }
+
+    HashMulXor_Padded_avx2(records + i * kRecordSize, count - i, hashes + i);
+}
+
+
+void HashMulXor_Padded(const char* records, size_t count, uint64_t* hashes) {
+    cpu_Level level = cpu_GetLevel();
+
+    if (level >= CPU_LEVEL_AVX512) {
+        HashMulXor_Padded_avx512(records, count, hashes);
+        return;
+    }
+    if (level >= CPU_LEVEL_AVX2) {
+        HashMulXor_Padded_avx2(records, count, hashes);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t chunks[2] = {};
+        memcpy(chunks, records + i * kRecordSize, sizeof(chunks));
+
+        hashes[i] = MulXorMix(MulXorBlock(chunks, kMulXorKeys));
+    }
+}
+
+
+// Bytes of a key to keep: kKeepBytes + 16 - len starts with len 0xFF.
+alignas(16) static const unsigned char kKeepBytes[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// A 16-byte load that stays inside the page of the key can't fault, so
+// it may read past the key and mask the rest off; the overlapping loads of
+// HashLoad16 branch on the length, which mispredicts on mixed words.
+// An empty key may point at the start of a page that isn't mapped.
+__attribute__((no_sanitize_address))
+inline static void StageKey(const char* str, size_t len, uint64_t* record) {
+    if (__builtin_expect(((uintptr_t) str & 4095) > 4096 - kRecordSize || len == 0, 0)) {
+        HashLoad16(str, len, record);
+        return;
+    }
+
+    __m128i key  = _mm_loadu_si128((const __m128i*) str);
+    __m128i keep = _mm_loadu_si128((const __m128i*)(kKeepBytes + kRecordSize - len));
+
+    _mm_store_si128((__m128i*) record, _mm_and_si128(key, keep));
+}
+
+
+// Loads up to kStagedKeys keys into records, hashes them with hash_padded
+// and hashes the long ones again with hash_function.
+static void HashStaged(const char* const* strs, const size_t* lens, size_t count,
+                       uint64_t* hashes,
+                       void (*hash_padded)(const char* records, size_t count, uint64_t* hashes),
+                       uint64_t (*hash_function)(const void* mem, size_t size)) {
+    alignas(64) uint64_t records[kStagedKeys * 2];
+
+    for (size_t start = 0; start < count; start += kStagedKeys) {
+        size_t n_keys = (count - start < kStagedKeys) ? count - start : kStagedKeys;
+
+        for (size_t i = 0; i < n_keys; i++) {
+            size_t len = lens[start + i];
+            StageKey(strs[start + i], len < kRecordSize ? len : kRecordSize, &records[i * 2]);
+        }
+
+        hash_padded((const char*) records, n_keys, hashes + start);
+
+        for (size_t i = 0; i < n_keys; i++) {
+            if (lens[start + i] > kRecordSize) {
+                hashes[start + i] = hash_function(strs[start + i], lens[start + i]);
+            }
+        }
+    }
+}
+
+
+void HashCRC32_Batch(const char* const* strs, const size_t* lens, size_t count,
+                     uint64_t* hashes) {
+    HashStaged(strs, lens, count, hashes, HashCRC32_Padded, HashCRC32_long);
+}
+
+
+void HashMulXor_Batch(const char* const* strs, const size_t* lens, size_t count,
+                      uint64_t* hashes) {
+    HashStaged(strs, lens, count, hashes, HashMulXor_Padded, HashMulXor);
+}
+
+
+HashBatchFunction GetHashBatch(uint64_t (*hash_function)(const void* mem, size_t size)) {
+    if (hash_function == HashCRC32_inline) {
+        return HashCRC32_Batch;
+    }
+    if (hash_function == HashMulXor) {
+        return HashMulXor_Batch;
+    }
+
+    return nullptr;
+}
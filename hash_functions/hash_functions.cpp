@@ -71,7 +71,43 @@ uint64_t HashRotateLeft(const void* mem, size_t size) {
 }
 
 
-uint64_t HashCRC32_C(const void* mem, size_t size) {
+// CRC32C as the crc32 instruction computes it: reflected polynomial
+// 0x82F63B78, no inversions. A 2-, 4- or 8-byte crc32 is the same as
+// the bytewise CRC of its little-endian bytes.
+struct Crc32Table {
+    uint32_t entries[256];
+};
+
+static constexpr Crc32Table MakeCrc32Table() {
+    Crc32Table table = {};
+
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+        }
+
+        table.entries[byte] = crc;
+    }
+
+    return table;
+}
+
+static constexpr Crc32Table kCrc32Table = MakeCrc32Table();
+
+inline static uint32_t Crc32Bytes(uint32_t crc, const void* mem, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)mem;
+
+    for (size_t i = 0; i < size; i++) {
+        crc = kCrc32Table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+
+__attribute__((target("sse4.2")))
+static uint64_t HashCRC32_C_sse42(const void* mem, size_t size) {
     uint32_t cur_hash = 0xDEADDEAD;
     for (int i = 0; i < size; i++) {
         cur_hash = _mm_crc32_u8(cur_hash, ((const uint8_t*)mem)[i]);
@@ -81,6 +117,16 @@ uint64_t HashCRC32_C(const void* mem, size_t size) {
 }
 
 
+uint64_t HashCRC32_C(const void* mem, size_t size) {
+    if (cpu_GetLevel() < CPU_LEVEL_SSE42) {
+        return Crc32Bytes(0xDEADDEAD, mem, size);
+    }
+
+    return HashCRC32_C_sse42(mem, size);
+}
+
+
+__attribute__((target("sse4.2")))
 uint64_t HashCRC32_C_unroll(const void* mem, size_t size) {
     uint32_t cur_hash = 0xDEADDEAD;
     switch (size) {
@@ -106,26 +152,163 @@ uint64_t HashCRC32_C_unroll(const void* mem, size_t size) {
 }
 
 
-#include <string.h>
 uint64_t HashCRC32_inline(const void* data, size_t length) {
+    return HashCRC32_16(data, length);
+}
+
+
+uint64_t HashCRC32_16_scalar(const void* data, size_t length) {
+    uint64_t chunks[2] = {};
+    HashLoad16(data, length, chunks);
+
+    return Crc32Bytes(0, chunks, sizeof(chunks));
+}
+
+
+// The crc32 code in hash_CRC32.asm.
+extern "C" uint64_t HashCRC32_asm_sse42(const void* mem, size_t size);
+
+// Same order of chunks as the asm: the tail first, from its last byte,
+// then the first 8 bytes. An empty key reads one byte, like the asm.
+static uint64_t HashCRC32_asm_scalar(const void* mem, size_t size) {
+    const char* c_mem = (const char*)mem;
+    uint32_t hash = 0xDEADDEAD;
+
+    if (size == 3) {
+        return Crc32Bytes(hash, c_mem, 3);
+    }
+
+    size_t base = (size > 8) ? 8 : 0;
+    size_t tail = (size == 0) ? 1 : size - base;
+
+    if (tail & 1) hash = Crc32Bytes(hash, c_mem + base + tail - 1, 1);
+    if (tail & 2) hash = Crc32Bytes(hash, c_mem + base + (tail & 4), 2);
+    if (tail & 4) hash = Crc32Bytes(hash, c_mem + base, 4);
+    if (tail & 8) hash = Crc32Bytes(hash, c_mem + base, 8);
+
+    if (base) {
+        hash = Crc32Bytes(hash, c_mem, 8);
+    }
+
+    return hash;
+}
+
+
+extern "C" uint64_t HashCRC32_asm(const void* mem, size_t size) {
+    if (size > 16) {
+        return HashCRC32_long(mem, size);
+    }
+
+    if (cpu_GetLevel() < CPU_LEVEL_SSE42) {
+        return HashCRC32_asm_scalar(mem, size);
+    }
+
+    return HashCRC32_asm_sse42(mem, size);
+}
+
+
+// The tail is zero-padded to a whole chunk, like in HashCRC32_16.
+__attribute__((target("sse4.2")))
+static uint64_t HashCRC32_long_sse42(const void* mem, size_t size) {
+    const char* c_mem = (const char*)mem;
     uint64_t hash = 0;
 
-    alignas(16) char str[16] = {};
+    size_t pos = 0;
+    for (; pos + 8 <= size; pos += 8) {
+        uint64_t chunk = 0;
+        memcpy(&chunk, c_mem + pos, 8);
+
+        hash = _mm_crc32_u64(hash, chunk);
+    }
+
+    if (pos < size) {
+        uint64_t chunk = 0;
+        memcpy(&chunk, c_mem + pos, size - pos);
+
+        hash = _mm_crc32_u64(hash, chunk);
+    }
+
+    return hash;
+}
+
+
+static uint64_t HashCRC32_long_scalar(const void* mem, size_t size) {
+    const char* c_mem = (const char*)mem;
+    size_t whole = size / 8 * 8;
+
+    uint32_t hash = Crc32Bytes(0, c_mem, whole);
+
+    if (whole < size) {
+        char chunk[8] = {};
+        memcpy(chunk, c_mem + whole, size - whole);
 
-    memcpy(str, data, length);
+        hash = Crc32Bytes(hash, chunk, sizeof(chunk));
+    }
 
-    asm(
-        "crc32 %[hash], qword ptr [%[str] + 0]\n\t"
-        "crc32 %[hash], qword ptr [%[str] + 8]\n\t"
-        : [hash] "+r" (hash)
-        : [str] "r" (str)
-        : "memory"
-    );
-    
     return hash;
 }
 
 
+extern "C" uint64_t HashCRC32_long(const void* mem, size_t size) {
+    if (cpu_GetLevel() < CPU_LEVEL_SSE42) {
+        return HashCRC32_long_scalar(mem, size);
+    }
+
+    return HashCRC32_long_sse42(mem, size);
+}
+
+
+// 16 bytes per step, the seed is added to both chunks. The high 32 bits
+// of the seed are the initial value.
+__attribute__((target("sse4.2")))
+static uint64_t HashCRC32_Seeded_sse42(const void* mem, size_t size, uint64_t seed) {
+    const char* c_mem = (const char*)mem;
+    uint64_t hash = seed >> 32;
+
+    size_t pos = 0;
+    do {
+        uint64_t chunks[2] = {};
+        HashLoad16(c_mem + pos, (size - pos < 16) ? size - pos : 16, chunks);
+
+        hash = _mm_crc32_u64(hash, chunks[0] + seed);
+        hash = _mm_crc32_u64(hash, chunks[1] + seed);
+
+        pos += 16;
+    } while (pos < size);
+
+    return hash;
+}
+
+
+static uint64_t HashCRC32_Seeded_scalar(const void* mem, size_t size, uint64_t seed) {
+    const char* c_mem = (const char*)mem;
+    uint32_t hash = (uint32_t)(seed >> 32);
+
+    size_t pos = 0;
+    do {
+        uint64_t chunks[2] = {};
+        HashLoad16(c_mem + pos, (size - pos < 16) ? size - pos : 16, chunks);
+
+        chunks[0] += seed;
+        chunks[1] += seed;
+        hash = Crc32Bytes(hash, chunks, sizeof(chunks));
+
+        pos += 16;
+    } while (pos < size);
+
+    return hash;
+}
+
+
+uint64_t HashCRC32_Seeded(const void* mem, size_t size, uint64_t seed) {
+    if (cpu_GetLevel() < CPU_LEVEL_SSE42) {
+        return HashCRC32_Seeded_scalar(mem, size, seed);
+    }
+
+    return HashCRC32_Seeded_sse42(mem, size, seed);
+}
+
+
 
 uint64_t HashKR(const void* mem, size_t size) {
     uint64_t hash = 0;
@@ -178,10 +361,9 @@ uint64_t HashElf(const void* mem, size_t size) {
 
 
 // source: https://ru.wikipedia.org/wiki/MurmurHash2
-uint64_t HashMurmur2(const void* mem, size_t size) 
+uint64_t HashMurmur2_Seeded(const void* mem, size_t size, uint64_t seed)
 {
     const size_t m = 0x5bd1e995;
-    const size_t seed = 0;
     const char* key = (const char*)mem;
     const int r = 24;
 
@@ -225,3 +407,9 @@ uint64_t HashMurmur2(const void* mem, size_t size)
 
     return h;
 }
+
+
+uint64_t HashMurmur2(const void* mem, size_t size)
+{
+    return HashMurmur2_Seeded(mem, size, 0);
+}
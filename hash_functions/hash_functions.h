@@ -2,8 +2,11 @@
 #define HASH_FUNCTIONS_H_
 
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
+#include "cpu_features.h"
+
 struct HashFunction {
     uint64_t (*hash_func)(const void* mem, size_t size); // typedef
     const char* description;
@@ -23,6 +26,111 @@ uint64_t HashMurmur2     (const void* mem, size_t size);
 extern "C" uint64_t HashCRC32_asm  (const void* mem, size_t size);
 uint64_t HashCRC32_C     (const void* mem, size_t size);
 uint64_t HashCRC32_inline(const void* mem, size_t size);
+uint64_t HashMulXor      (const void* mem, size_t size);
+uint64_t HashAES         (const void* mem, size_t size);
+
+// CRC32 over 8-byte chunks, for keys longer than 16 bytes.
+// HashCRC32_asm and HashCRC32_16 jump here for them.
+extern "C" uint64_t HashCRC32_long(const void* mem, size_t size);
+
+// Reads a key of up to 16 bytes as two zero-padded 8-byte chunks, with
+// overlapping loads that stay inside the key. A memcpy of a variable length
+// costs more than the hash itself, and the wider loads that read its result
+// back can't be forwarded from its stores.
+inline void HashLoad16(const void* data, size_t length, uint64_t chunks[2]) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    if (length >= 8) {
+        memcpy(&lo, bytes, 8);
+
+        if (length > 8) {
+            memcpy(&hi, bytes + length - 8, 8);
+            hi >>= 8 * (16 - length);
+        }
+    } else if (length >= 4) {
+        uint32_t first = 0;
+        uint32_t last = 0;
+        memcpy(&first, bytes, 4);
+        memcpy(&last, bytes + length - 4, 4);
+
+        lo = first | (uint64_t)last << (8 * (length - 4));
+    } else if (length > 0) {
+        lo = bytes[0] | (uint64_t)bytes[length / 2] << (8 * (length / 2)) |
+             (uint64_t)bytes[length - 1] << (8 * (length - 1));
+    }
+
+    chunks[0] = lo;
+    chunks[1] = hi;
+}
+
+// The CRC32 functions need SSE4.2 for the crc32 instruction. Without it they
+// compute the same CRC32C with a table, so the hashes don't depend on the
+// machine and a table image saved on one loads on any other.
+uint64_t HashCRC32_16_scalar(const void* data, size_t length);
+
+// Body of HashCRC32_inline. It's here so that HashTable<ht_CRC32Hash, ...>
+// can inline it. Up to 16 symbols it's two crc32 instructions.
+inline uint64_t HashCRC32_16(const void* data, size_t length) {
+    if (__builtin_expect(length > 16, 0)) {
+        return HashCRC32_long(data, length);
+    }
+
+#ifndef __SSE4_2__
+    if (__builtin_expect(cpu_GetLevel() < CPU_LEVEL_SSE42, 0)) {
+        return HashCRC32_16_scalar(data, length);
+    }
+#endif
+
+    uint64_t hash = 0;
+
+    uint64_t chunks[2] = {};
+    HashLoad16(data, length, chunks);
+
+    // Written before hi is read, so it can't share a register with it.
+    asm(
+        "crc32 %[hash], %[lo]\n\t"
+        "crc32 %[hash], %[hi]\n\t"
+        : [hash] "+&r" (hash)
+        : [lo] "r" (chunks[0]), [hi] "r" (chunks[1])
+    );
+
+    return hash;
+}
+
+// Batch kernels, see hash_batch.cpp. They give the same hashes as
+// HashCRC32_inline and HashMulXor, for many keys at once.
+typedef void (*HashBatchFunction)(const char* const* strs, const size_t* lens, size_t count,
+                                  uint64_t* hashes);
+
+void HashCRC32_Batch  (const char* const* strs, const size_t* lens, size_t count,
+                       uint64_t* hashes);
+void HashMulXor_Batch (const char* const* strs, const size_t* lens, size_t count,
+                       uint64_t* hashes);
+
+// Keys in zero-padded 16-byte records, made by ftbTransferBufferTo16 or ftbTokenize.
+void HashCRC32_Padded (const char* records, size_t count, uint64_t* hashes);
+void HashMulXor_Padded(const char* records, size_t count, uint64_t* hashes);
+
+// The batch kernel of hash_function, nullptr if it has none.
+HashBatchFunction GetHashBatch(uint64_t (*hash_function)(const void* mem, size_t size));
+
+// Seeded variants, for ht_ContructorSeeded: every table draws its own seed,
+// so keys that collide in it can't be computed in advance. With seed 0 they
+// hash like HashMurmur2, HashMulXor, HashAES, and HashCRC32_inline up to
+// 16 bytes.
+//
+// The seed of CRC32 is added to the data, not only used as the initial
+// value: CRC32 is linear, keys of one length that collide under one initial
+// value collide under all of them. Murmur2 has collisions that work under
+// any seed too, MulXor and AES are the ones for hostile keys.
+typedef uint64_t (*HashSeededFunction)(const void* mem, size_t size, uint64_t seed);
+
+uint64_t HashCRC32_Seeded (const void* mem, size_t size, uint64_t seed);
+uint64_t HashMurmur2_Seeded(const void* mem, size_t size, uint64_t seed);
+uint64_t HashMulXor_Seeded(const void* mem, size_t size, uint64_t seed);
+uint64_t HashAES_Seeded   (const void* mem, size_t size, uint64_t seed);
 
 const HashFunction gHashFunctions[] = 
 {
@@ -38,6 +146,8 @@ const HashFunction gHashFunctions[] =
     {HashCRC32_C,     "CRC32_C hash"},
     {HashCRC32_asm,   "CRC32_asm hash"},
     {HashMurmur2,     "murmur hash"},
+    {HashMulXor,      "MulXor hash"},
+    {HashAES,         "AES hash"},
     {HashKR,          "KR Hash"},
 };
 
@@ -0,0 +1,169 @@
+#include "arena.h"
+
+#include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <immintrin.h>
+
+const size_t ar_gChunkHeader = 16; // keeps the blocks 16-byte aligned
+
+static_assert(sizeof(ar_Chunk) <= ar_gChunkHeader, "chunk header doesn't fit");
+
+
+static void ar_Lock(ar_Arena* arena) {
+    while (__atomic_exchange_n(&arena->lock, 1, __ATOMIC_ACQUIRE)) {
+        _mm_pause();
+    }
+}
+
+
+static void ar_Unlock(ar_Arena* arena) {
+    __atomic_store_n(&arena->lock, 0, __ATOMIC_RELEASE);
+}
+
+
+static size_t ar_GetClass(size_t size, size_t* block_size) {
+    if (size <= ar_gSmallLimit) {
+        *block_size = (size + 15) & ~(size_t) 15;
+        return *block_size / 16 - 1;
+    }
+
+    size_t log = 64 - (size_t) __builtin_clzll(size - 1);
+
+    *block_size = (size_t) 1 << log;
+    return ar_gSmallLimit / 16 + log - 10;
+}
+
+
+static ar_Chunk* ar_MapChunk(size_t size, bool huge_pages) {
+    void* mem = MAP_FAILED;
+
+    if (huge_pages) {
+        mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+
+    // There may be no reserved huge pages, ask for transparent ones then.
+    if (mem == MAP_FAILED) {
+        mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            return nullptr;
+        }
+
+        if (huge_pages) {
+            madvise(mem, size, MADV_HUGEPAGE);
+        }
+    }
+
+    ar_Chunk* chunk = (ar_Chunk*) mem;
+    chunk->size = size;
+
+    return chunk;
+}
+
+
+static void* ar_ArenaAlloc(void* ctx, size_t size) {
+    return ar_Alloc((ar_Arena*) ctx, size);
+}
+
+
+static void ar_ArenaFree(void* ctx, void* ptr, size_t size) {
+    ar_Free((ar_Arena*) ctx, ptr, size);
+}
+
+
+void ar_Contructor(ar_Arena* arena, bool huge_pages) {
+    assert(arena);
+
+    memset(arena, 0, sizeof(*arena));
+
+    arena->allocator = {
+        .alloc = ar_ArenaAlloc,
+        .free  = ar_ArenaFree,
+        .ctx   = arena,
+    };
+
+    arena->huge_pages = huge_pages;
+}
+
+
+void ar_Destructor(ar_Arena* arena) {
+    assert(arena);
+
+    ar_Chunk* chunk = arena->chunks;
+
+    while (chunk) {
+        ar_Chunk* next = chunk->next;
+        munmap(chunk, chunk->size);
+        chunk = next;
+    }
+
+    memset(arena, 0, sizeof(*arena));
+}
+
+
+// The memory is zeroed, as DLL_Allocator requires.
+void* ar_Alloc(ar_Arena* arena, size_t size) {
+    assert(arena);
+
+    size_t block_size = 0;
+    size_t size_class = ar_GetClass(size, &block_size);
+
+    ar_Lock(arena);
+
+    void* block = arena->free_lists[size_class];
+    if (block) {
+        arena->free_lists[size_class] = *(void**) block;
+        ar_Unlock(arena);
+
+        memset(block, 0, block_size);
+        return block;
+    }
+
+    // The rest of the current chunk is abandoned, it's less than a block.
+    if ((size_t)(arena->end - arena->cur) < block_size) {
+        size_t chunk_size = ar_gChunkSize;
+        while (chunk_size < block_size + ar_gChunkHeader) {
+            chunk_size *= 2;
+        }
+
+        ar_Chunk* chunk = ar_MapChunk(chunk_size, arena->huge_pages);
+        if (chunk == nullptr) {
+            ar_Unlock(arena);
+            return nullptr;
+        }
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+
+        arena->cur = (char*) chunk + ar_gChunkHeader;
+        arena->end = (char*) chunk + chunk_size;
+    }
+
+    // Fresh pages are zero already.
+    block = arena->cur;
+    arena->cur += block_size;
+
+    ar_Unlock(arena);
+
+    return block;
+}
+
+
+void ar_Free(ar_Arena* arena, void* ptr, size_t size) {
+    assert(arena);
+
+    if (ptr == nullptr) {
+        return;
+    }
+
+    size_t block_size = 0;
+    size_t size_class = ar_GetClass(size, &block_size);
+
+    ar_Lock(arena);
+
+    *(void**) ptr = arena->free_lists[size_class];
+    arena->free_lists[size_class] = ptr;
+
+    ar_Unlock(arena);
+}
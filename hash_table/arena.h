@@ -0,0 +1,46 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "../list/include/DLL.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+// Backing store for all the buckets of a table. Memory is taken from the
+// system in big chunks and handed out by bumping a pointer, so the arrays
+// of neighbouring buckets are neighbours in memory too. Freed blocks go to
+// size-class free lists and are reused, chunks are returned to the system
+// only by ar_Destructor.
+
+// One 2 MB huge page.
+const size_t ar_gChunkSize = 2 * 1024 * 1024;
+
+// Blocks up to this size are rounded to 16 bytes, bigger ones to a power of two.
+const size_t ar_gSmallLimit = 1024;
+const size_t ar_gNumClasses = 128;
+
+struct ar_Chunk {
+    ar_Chunk* next;
+    size_t size;        // of the whole mapping, header included
+};
+
+struct ar_Arena {
+    DLL_Allocator allocator;    // give it to the lists, ctx is the arena itself
+    bool huge_pages;
+
+    uint32_t lock;              // lists of one table may be filled from several threads
+    ar_Chunk* chunks;
+    char* cur;
+    char* end;
+
+    void* free_lists[ar_gNumClasses];
+};
+
+// huge_pages asks for MAP_HUGETLB and falls back to transparent huge pages.
+void  ar_Contructor(ar_Arena* arena, bool huge_pages);
+void  ar_Destructor(ar_Arena* arena);
+
+void* ar_Alloc     (ar_Arena* arena, size_t size);
+void  ar_Free      (ar_Arena* arena, void* ptr, size_t size);
+
+#endif
@@ -0,0 +1,385 @@
+#include "concurrent_table.h"
+#include "hash_table_template.h"
+#include "hash_key.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+typedef HashTable<ht_RuntimeHash, ht_ModuloBuckets> ct_ShardTable;
+
+const uint32_t ct_gWriterBit = 1u << 31;
+
+
+static void ct_LockShared(uint32_t* lock) {
+    for (;;) {
+        uint32_t state = __atomic_load_n(lock, __ATOMIC_RELAXED);
+
+        if (!(state & ct_gWriterBit) &&
+            __atomic_compare_exchange_n(lock, &state, state + 1, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+
+        _mm_pause();
+    }
+}
+
+
+static void ct_UnlockShared(uint32_t* lock) {
+    __atomic_fetch_sub(lock, 1, __ATOMIC_RELEASE);
+}
+
+
+// The writer bit is taken first, so new readers can't starve the writer.
+static void ct_Lock(uint32_t* lock) {
+    for (;;) {
+        uint32_t state = __atomic_load_n(lock, __ATOMIC_RELAXED);
+
+        if (!(state & ct_gWriterBit) &&
+            __atomic_compare_exchange_n(lock, &state, state | ct_gWriterBit, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+        _mm_pause();
+    }
+
+    while (__atomic_load_n(lock, __ATOMIC_ACQUIRE) != ct_gWriterBit) {
+        _mm_pause();
+    }
+}
+
+
+static void ct_Unlock(uint32_t* lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+
+// Called with the exclusive lock taken, so the shard has a single writer.
+static void ct_WriteBegin(ct_Shard* shard) {
+    __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void ct_WriteEnd(ct_Shard* shard) {
+    __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+// Everything read before it is consistent if the sequence hasn't changed.
+inline static bool ct_Validate(const ct_Shard* shard, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&shard->seq, __ATOMIC_RELAXED) == seq;
+}
+
+
+#define CT_LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+
+// elem_key is a validated copy, a long key it points to is kept alive by the epoch.
+inline static bool ct_KeyEquals(__m128i elem_key, __m128i key, bool is_inline,
+                                const char* str, size_t len) {
+    if (is_inline) {
+        return ht_InlineKeyEquals(key, elem_key);
+    }
+
+    ht_ListElem elem = {};
+    _mm_store_si128((__m128i*) elem.key, elem_key);
+
+    return ht_LongElemEquals(&elem, str, len);
+}
+
+
+// Walks the chain like listLookUp16_hash, but validates the sequence before
+// following any index or pointer, so a concurrent writer can't send it
+// out of bounds. Returns 1 if found, 0 if not, -1 if the read must be retried.
+static int ct_ReadChain(const ct_Shard* shard, uint32_t seq, const List* list,
+                        __m128i key, bool is_inline, const char* str, size_t len,
+                        uint64_t hash, size_t* value) {
+    const ht_ListElem* data = CT_LOAD(list->data);
+    const int*         next = CT_LOAD(list->next);
+
+    if (!ct_Validate(shard, seq)) {
+        return -1;
+    }
+
+    // Not constructed yet
+    if (data == nullptr) {
+        return 0;
+    }
+
+    int index = CT_LOAD(next[-1]);
+
+    for (;;) {
+        if (!ct_Validate(shard, seq)) {
+            return -1;
+        }
+
+        if (index == -1) {
+            return 0;
+        }
+
+        const ht_ListElem* elem = &data[index];
+
+        uint64_t elem_hash   = CT_LOAD(elem->hash);
+        __m128i  elem_key    = _mm_load_si128((const __m128i*)elem->key);
+        size_t   occurrences = CT_LOAD(elem->occurrences);
+        int      next_index  = CT_LOAD(next[index]);
+
+        // The key may be torn, it's only used if the sequence is still the same.
+        if (!ct_Validate(shard, seq)) {
+            return -1;
+        }
+
+        if (elem_hash == hash && ct_KeyEquals(elem_key, key, is_inline, str, len)) {
+            *value = occurrences;
+            return 1;
+        }
+
+        index = next_index;
+    }
+}
+
+
+static int ct_TryLookUp(const ct_Shard* shard, __m128i key, bool is_inline,
+                        const char* str, size_t len, uint64_t hash, size_t* value) {
+    uint32_t seq = __atomic_load_n(&shard->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+        return -1;
+    }
+
+    const ht_HashTable* ht = &shard->table;
+
+    const List* lists         = CT_LOAD(ht->lists);
+    size_t      n_buckets     = CT_LOAD(ht->n_buckets);
+    const List* old_lists     = CT_LOAD(ht->old_lists);
+    size_t      old_n_buckets = CT_LOAD(ht->old_n_buckets);
+    size_t      rehash_index  = CT_LOAD(ht->rehash_index);
+
+    if (!ct_Validate(shard, seq)) {
+        return -1;
+    }
+
+    // Same order as HashTable::GetListByString.
+    if (old_lists) {
+        size_t old_index = ht_ModuloBuckets::GetIndex(hash, old_n_buckets);
+
+        if (old_index >= rehash_index) {
+            int found = ct_ReadChain(shard, seq, &old_lists[old_index], key, is_inline,
+                                     str, len, hash, value);
+            if (found != 0) {
+                return found;
+            }
+        }
+    }
+
+    return ct_ReadChain(shard, seq, &lists[ht_ModuloBuckets::GetIndex(hash, n_buckets)],
+                        key, is_inline, str, len, hash, value);
+}
+
+#undef CT_LOAD
+
+
+static void* ct_Alloc(void* ctx, size_t size) {
+    (void) ctx;
+    return calloc(size, 1);
+}
+
+
+static void ct_Free(void* ctx, void* ptr, size_t size) {
+    (void) size;
+    ebr_Retire((ebr_Domain*) ctx, ptr);
+}
+
+
+// Shards use the high bits of the mixed hash, buckets inside a shard
+// use hash % n_buckets, so the two don't correlate.
+inline static ct_Shard* ct_GetShard(ct_ConcurrentTable* ct, uint64_t hash) {
+    uint64_t mixed = (hash * 0x9E3779B97F4A7C15ull) >> 32;
+
+    return &ct->shards[(mixed * ct->n_shards) >> 32];
+}
+
+
+void ct_SetMaxLoadFactor(ct_ConcurrentTable* ct, float max_load_factor) {
+    assert(ct);
+
+    for (size_t i = 0; i < ct->n_shards; i++) {
+        ct_Lock(&ct->shards[i].lock);
+        ht_SetMaxLoadFactor(&ct->shards[i].table, max_load_factor);
+        ct_Unlock(&ct->shards[i].lock);
+    }
+}
+
+
+ht_Error ct_Remove(ct_ConcurrentTable* ct, const char* str, size_t len) {
+    assert(ct);
+    assert(str);
+
+    uint64_t hash = ct->hash_function(str, len);
+    ct_Shard* shard = ct_GetShard(ct, hash);
+
+    ct_Lock(&shard->lock);
+    ct_WriteBegin(shard);
+
+    ht_Error err = ct_ShardTable::RemoveHashed(&shard->table, str, len, hash);
+
+    ct_WriteEnd(shard);
+    ct_Unlock(&shard->lock);
+
+    return err;
+}
+
+
+ht_Error ct_LookUp(ct_ConcurrentTable* ct, const char* str, size_t len, size_t* value) {
+    assert(ct);
+    assert(str);
+
+    uint64_t hash = ct->hash_function(str, len);
+    ct_Shard* shard = ct_GetShard(ct, hash);
+
+    if (ebr_Enter(ct->domain)) {
+        bool is_inline = ht_IsInlineKey(str, len);
+        __m128i key = is_inline ? ht_LoadKey(str, len) : _mm_setzero_si128();
+
+        for (int attempt = 0; attempt < ct_gOptimisticRetries; attempt++) {
+            int found = ct_TryLookUp(shard, key, is_inline, str, len, hash, value);
+
+            if (found != -1) {
+                ebr_Exit(ct->domain);
+
+                if (found == 0) {
+                    *value = 0;
+                    return HT_ERR_NO_SUCH_ELEMENT;
+                }
+
+                return HT_ERR_NO;
+            }
+
+            _mm_pause();
+        }
+
+        ebr_Exit(ct->domain);
+    }
+
+    // Writers keep the shard busy, wait for them.
+    ct_LockShared(&shard->lock);
+
+    ht_ListElem* elem = ct_ShardTable::FindHashed(&shard->table, str, len, hash);
+    *value = elem ? __atomic_load_n(&elem->occurrences, __ATOMIC_RELAXED) : 0;
+
+    ct_UnlockShared(&shard->lock);
+
+    return elem ? HT_ERR_NO : HT_ERR_NO_SUCH_ELEMENT;
+}
+
+
+ht_Error ct_Insert(ct_ConcurrentTable* ct, const char* str, size_t len) {
+    assert(ct);
+    assert(str);
+
+    uint64_t hash = ct->hash_function(str, len);
+    ct_Shard* shard = ct_GetShard(ct, hash);
+
+    // Most inserts of a word count are hits, they don't need the exclusive lock.
+    ct_LockShared(&shard->lock);
+
+    ht_ListElem* elem = ct_ShardTable::FindHashed(&shard->table, str, len, hash);
+    if (elem) {
+        __atomic_fetch_add(&elem->occurrences, 1, __ATOMIC_RELAXED);
+    }
+
+    ct_UnlockShared(&shard->lock);
+
+    if (elem) {
+        return HT_ERR_NO;
+    }
+
+    // Somebody may have inserted it in between, InsertHashed checks again.
+    ct_Lock(&shard->lock);
+    ct_WriteBegin(shard);
+
+    ht_Error err = ct_ShardTable::InsertHashed(&shard->table, str, len, hash);
+
+    ct_WriteEnd(shard);
+    ct_Unlock(&shard->lock);
+
+    return err;
+}
+
+
+ht_Error ct_Contructor(ct_ConcurrentTable* ct, size_t n_shards, size_t n_buckets,
+                       uint64_t (*hash_function)(const void* mem, size_t size)) {
+    assert(ct);
+    assert(n_shards > 0);
+    assert(n_buckets >= n_shards);
+
+    ebr_Domain* domain = (ebr_Domain*) aligned_alloc(alignof(ebr_Domain), sizeof(ebr_Domain));
+    if (domain == nullptr) {
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    if (!ebr_Contructor(domain)) {
+        free(domain);
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    ct_Shard* shards = (ct_Shard*) aligned_alloc(alignof(ct_Shard), n_shards * sizeof(ct_Shard));
+    if (shards == nullptr) {
+        ebr_Destructor(domain);
+        free(domain);
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    ct->allocator = {
+        .alloc = ct_Alloc,
+        .free  = ct_Free,
+        .ctx   = domain,
+    };
+
+    for (size_t i = 0; i < n_shards; i++) {
+        shards[i].lock = 0;
+        shards[i].seq  = 0;
+
+        ht_Error err = ct_ShardTable::Contructor(&shards[i].table, n_buckets / n_shards,
+                                                 &ct->allocator);
+        if (err) {
+            for (size_t j = 0; j < i; j++) {
+                ct_ShardTable::Destructor(&shards[j].table);
+            }
+
+            ebr_Destructor(domain);
+            free(domain);
+            free(shards);
+            return err;
+        }
+
+        shards[i].table.hash_function = hash_function;
+    }
+
+    ct->hash_function = hash_function;
+    ct->n_shards = n_shards;
+    ct->shards = shards;
+    ct->domain = domain;
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error ct_Destructor(ct_ConcurrentTable* ct) {
+    assert(ct);
+
+    for (size_t i = 0; i < ct->n_shards; i++) {
+        ct_ShardTable::Destructor(&ct->shards[i].table);
+    }
+
+    // Everything the shards have freed is still retired.
+    ebr_Destructor(ct->domain);
+
+    free(ct->domain);
+    free(ct->shards);
+
+    return HT_ERR_NO;
+}
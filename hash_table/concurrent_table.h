@@ -0,0 +1,47 @@
+#ifndef CONCURRENT_TABLE_H_
+#define CONCURRENT_TABLE_H_
+
+#include "hash_table.h"
+#include "epoch.h"
+
+// Thread-safe List table. Buckets are split between shards, every shard is an
+// ordinary ht_HashTable guarded by its own reader-writer spinlock.
+// Inserts of existing strings only take the lock shared,
+// occurrences are incremented atomically then.
+//
+// Lookups take no lock at all: every structural change of a shard is wrapped
+// into an odd/even sequence number (seqlock), readers validate it after every
+// step and retry if a writer has been there. The memory a writer frees is
+// retired to an epoch domain, so readers never touch recycled arrays.
+
+struct alignas(64) ct_Shard {
+    uint32_t lock;      // writer bit | number of readers
+    uint32_t seq;       // odd while the shard is being modified
+    ht_HashTable table;
+};
+
+// Lists keep a pointer to the allocator, so the table must not be moved
+// after the constructor.
+struct ct_ConcurrentTable {
+    uint64_t (*hash_function)(const void* mem, size_t size);
+    size_t n_shards;
+    ct_Shard* shards;
+    ebr_Domain* domain;
+    DLL_Allocator allocator;
+};
+
+const size_t ct_gDefaultShards = 64;
+
+// Optimistic attempts of a lookup before it falls back to the shared lock.
+const int ct_gOptimisticRetries = 16;
+
+void     ct_SetMaxLoadFactor(ct_ConcurrentTable* ct, float max_load_factor);
+
+ht_Error ct_Remove    (ct_ConcurrentTable* ct, const char* str, size_t len);
+ht_Error ct_LookUp    (ct_ConcurrentTable* ct, const char* str, size_t len, size_t* value);
+ht_Error ct_Insert    (ct_ConcurrentTable* ct, const char* str, size_t len);
+ht_Error ct_Destructor(ct_ConcurrentTable* ct);
+ht_Error ct_Contructor(ct_ConcurrentTable* ct, size_t n_shards, size_t n_buckets,
+                       uint64_t (*hash_function)(const void* mem, size_t size));
+
+#endif
@@ -0,0 +1,186 @@
+#include "epoch.h"
+
+#include <assert.h>
+#include <immintrin.h>
+
+const uint64_t ebr_gQuiescent = UINT64_MAX;
+
+// Thread indices are shared by all the domains and returned when the thread exits.
+static uint8_t gSlotUsed[ebr_gMaxThreads] = {};
+
+struct ebr_ThreadIndex {
+    int index = -1;
+
+    ~ebr_ThreadIndex() {
+        if (index != -1) {
+            __atomic_store_n(&gSlotUsed[index], 0, __ATOMIC_RELEASE);
+        }
+    }
+};
+
+static thread_local ebr_ThreadIndex tThreadIndex;
+
+
+static int ebr_GetThreadIndex() {
+    if (tThreadIndex.index != -1) {
+        return tThreadIndex.index;
+    }
+
+    for (int i = 0; i < (int) ebr_gMaxThreads; i++) {
+        uint8_t expected = 0;
+
+        if (__atomic_compare_exchange_n(&gSlotUsed[i], &expected, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            tThreadIndex.index = i;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+static void ebr_Lock(ebr_Domain* domain) {
+    while (__atomic_exchange_n(&domain->lock, 1, __ATOMIC_ACQUIRE)) {
+        _mm_pause();
+    }
+}
+
+
+static void ebr_Unlock(ebr_Domain* domain) {
+    __atomic_store_n(&domain->lock, 0, __ATOMIC_RELEASE);
+}
+
+
+bool ebr_Contructor(ebr_Domain* domain) {
+    assert(domain);
+
+    domain->epoch = 0;
+    domain->lock = 0;
+    domain->n_retired = 0;
+    domain->capacity = ebr_gReclaimThreshold;
+
+    domain->retired = (ebr_Retired*) calloc(domain->capacity, sizeof(ebr_Retired));
+    if (domain->retired == nullptr) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ebr_gMaxThreads; i++) {
+        domain->slots[i].epoch = ebr_gQuiescent;
+    }
+
+    return true;
+}
+
+
+// Nobody may be inside a read section anymore.
+void ebr_Destructor(ebr_Domain* domain) {
+    assert(domain);
+
+    for (size_t i = 0; i < domain->n_retired; i++) {
+        free(domain->retired[i].ptr);
+    }
+
+    free(domain->retired);
+
+    domain->retired = nullptr;
+    domain->n_retired = 0;
+}
+
+
+bool ebr_Enter(ebr_Domain* domain) {
+    int index = ebr_GetThreadIndex();
+    if (index == -1) {
+        return false;
+    }
+
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&domain->slots[index].epoch, epoch, __ATOMIC_RELAXED);
+
+    // The announcement must be visible before any pointer is read.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    return true;
+}
+
+
+void ebr_Exit(ebr_Domain* domain) {
+    __atomic_store_n(&domain->slots[tThreadIndex.index].epoch, ebr_gQuiescent,
+                     __ATOMIC_RELEASE);
+}
+
+
+// The epoch moves on only when every active reader has seen the current one.
+static void ebr_TryAdvance(ebr_Domain* domain) {
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST);
+
+    for (size_t i = 0; i < ebr_gMaxThreads; i++) {
+        uint64_t slot_epoch = __atomic_load_n(&domain->slots[i].epoch, __ATOMIC_SEQ_CST);
+
+        if (slot_epoch != ebr_gQuiescent && slot_epoch != epoch) {
+            return;
+        }
+    }
+
+    __atomic_compare_exchange_n(&domain->epoch, &epoch, epoch + 1, false,
+                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+
+static void ebr_ReclaimLocked(ebr_Domain* domain) {
+    ebr_TryAdvance(domain);
+
+    uint64_t epoch = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST);
+
+    size_t n_left = 0;
+    for (size_t i = 0; i < domain->n_retired; i++) {
+        if (domain->retired[i].epoch + 2 <= epoch) {
+            free(domain->retired[i].ptr);
+        } else {
+            domain->retired[n_left++] = domain->retired[i];
+        }
+    }
+
+    domain->n_retired = n_left;
+}
+
+
+void ebr_Reclaim(ebr_Domain* domain) {
+    assert(domain);
+
+    ebr_Lock(domain);
+    ebr_ReclaimLocked(domain);
+    ebr_Unlock(domain);
+}
+
+
+// The block has to be unreachable for new readers already.
+void ebr_Retire(ebr_Domain* domain, void* ptr) {
+    assert(domain);
+
+    ebr_Lock(domain);
+
+    if (domain->n_retired == domain->capacity) {
+        ebr_ReclaimLocked(domain);
+    }
+
+    if (domain->n_retired == domain->capacity) {
+        ebr_Retired* retired = (ebr_Retired*) realloc(domain->retired,
+                                    domain->capacity * 2 * sizeof(ebr_Retired));
+        // Freeing it now may crash a reader, leaking is the lesser evil.
+        if (retired == nullptr) {
+            ebr_Unlock(domain);
+            return;
+        }
+
+        domain->retired = retired;
+        domain->capacity *= 2;
+    }
+
+    domain->retired[domain->n_retired++] = {
+        .ptr = ptr,
+        .epoch = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST),
+    };
+
+    ebr_Unlock(domain);
+}
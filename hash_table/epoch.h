@@ -0,0 +1,48 @@
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+// Epoch-based reclamation. Readers announce the global epoch while they may
+// hold pointers into the table, writers retire memory instead of freeing it.
+// A block retired in epoch e is freed once the global epoch reaches e + 2:
+// by then every reader that could have seen it has left.
+
+const size_t ebr_gMaxThreads = 256;
+
+// The number of retired blocks that triggers a reclamation attempt.
+const size_t ebr_gReclaimThreshold = 64;
+
+struct alignas(64) ebr_Slot {
+    uint64_t epoch; // ebr_gQuiescent when the thread is outside a read section
+};
+
+struct ebr_Retired {
+    void* ptr;
+    uint64_t epoch;
+};
+
+struct ebr_Domain {
+    alignas(64) uint64_t epoch;
+
+    alignas(64) uint32_t lock;  // guards the retired array
+    ebr_Retired* retired;
+    size_t n_retired;
+    size_t capacity;
+
+    ebr_Slot slots[ebr_gMaxThreads];
+};
+
+bool ebr_Contructor(ebr_Domain* domain);
+void ebr_Destructor(ebr_Domain* domain);
+
+// Returns false if there are more than ebr_gMaxThreads threads,
+// the caller should take a lock instead then.
+bool ebr_Enter  (ebr_Domain* domain);
+void ebr_Exit   (ebr_Domain* domain);
+
+void ebr_Retire (ebr_Domain* domain, void* ptr);
+void ebr_Reclaim(ebr_Domain* domain);
+
+#endif
@@ -0,0 +1,385 @@
+#include "frozen_table.h"
+#include "hash_key.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+// A new seed is needed only if two keys get the same 64-bit hash
+// or a pilot isn't found in time, both are very unlikely.
+const int fz_gMaxSeeds = 16;
+
+// 0.6 * 2^32.
+const uint64_t fz_gDenseKeys = 2576980378ull;
+
+const uint64_t fz_gK0 = 0xA0761D6478BD642Full;
+const uint64_t fz_gK1 = 0xE7037ED1A0B428DBull;
+const uint64_t fz_gK2 = 0x8EBC6AF09C88C6E3ull;
+
+struct fz_Builder {
+    const uint64_t* hashes;
+    size_t n_elems;
+    size_t n_buckets;
+    size_t n_dense;
+
+    size_t*   bucket_start; // keys of bucket b are [bucket_start[b], bucket_start[b + 1])
+    size_t*   keys;         // key indices ordered by bucket
+    size_t*   order;        // buckets, the biggest first
+    uint64_t* taken;        // a bit per slot
+    size_t*   slots;        // of the keys of the current bucket
+};
+
+
+// 64x64 -> 128-bit multiplication folded to 64 bits, as in wyhash.
+inline static uint64_t fz_Mum(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t) a * b;
+    return (uint64_t) product ^ (uint64_t)(product >> 64);
+}
+
+
+// The table hash function may have only 32 bits (CRC32), too few
+// to tell a million keys apart, so the keys are hashed again.
+inline static uint64_t fz_Hash(const char* str, size_t len, uint64_t seed) {
+    uint64_t words[2] = {};
+
+    if (len <= 16) {
+        memcpy(words, str, len);
+        return fz_Mum(fz_Mum(words[0] ^ fz_gK0 ^ seed, words[1] ^ fz_gK1), len ^ fz_gK2);
+    }
+
+    uint64_t hash = seed;
+
+    // The last block may overlap the previous one.
+    for (size_t pos = 0; pos < len; pos += 16) {
+        memcpy(words, str + (pos + 16 <= len ? pos : len - 16), 16);
+        hash = fz_Mum(words[0] ^ fz_gK0 ^ hash, words[1] ^ fz_gK1);
+    }
+
+    return fz_Mum(hash, len ^ fz_gK2);
+}
+
+
+// 60% of the keys go to the first 30% of the buckets (dense ones), as in
+// PTHash. The big buckets are placed first, while the table is almost
+// empty, and the rest are small, so the pilots are found much sooner.
+// Buckets take the low half of the hash, slots the whole hash.
+inline static size_t fz_GetBucket(uint64_t hash, size_t n_buckets, size_t n_dense) {
+    uint64_t low = hash & UINT32_MAX;
+
+    size_t dense  = (size_t)((low * n_dense) >> 32);
+    size_t sparse = n_dense + (size_t)((low * (n_buckets - n_dense)) >> 32);
+
+    return (hash >> 32) < fz_gDenseKeys ? dense : sparse;
+}
+
+
+inline static size_t fz_GetSlot(uint64_t hash, uint32_t pilot, size_t n_elems) {
+    uint64_t mixed = fz_Mum(hash ^ (pilot * fz_gK1), fz_gK2);
+    return (size_t)(((__uint128_t) mixed * n_elems) >> 64);
+}
+
+
+inline static bool fz_IsTaken(const uint64_t* taken, size_t slot) {
+    return taken[slot / 64] >> (slot % 64) & 1;
+}
+
+
+static int fz_CompareHashes(const void* a, const void* b) {
+    uint64_t hash_a = *(const uint64_t*) a;
+    uint64_t hash_b = *(const uint64_t*) b;
+
+    return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+
+// Keys with the same hash would need the same slot.
+static bool fz_HashesDiffer(const uint64_t* hashes, size_t n_elems, uint64_t* sorted) {
+    memcpy(sorted, hashes, n_elems * sizeof(uint64_t));
+    qsort(sorted, n_elems, sizeof(uint64_t), fz_CompareHashes);
+
+    for (size_t i = 1; i < n_elems; i++) {
+        if (sorted[i] == sorted[i - 1]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Groups the keys by bucket and orders the buckets by size, both with counting sorts.
+static void fz_SortBuckets(fz_Builder* builder) {
+    size_t n_buckets = builder->n_buckets;
+    size_t* bucket_start = builder->bucket_start;
+
+    memset(bucket_start, 0, (n_buckets + 1) * sizeof(size_t));
+
+    size_t n_dense = builder->n_dense;
+
+    for (size_t i = 0; i < builder->n_elems; i++) {
+        bucket_start[fz_GetBucket(builder->hashes[i], n_buckets, n_dense) + 1]++;
+    }
+
+    size_t max_size = 0;
+    for (size_t b = 0; b < n_buckets; b++) {
+        if (bucket_start[b + 1] > max_size) {
+            max_size = bucket_start[b + 1];
+        }
+
+        bucket_start[b + 1] += bucket_start[b];
+    }
+
+    // order is used as the cursors first.
+    memcpy(builder->order, bucket_start, n_buckets * sizeof(size_t));
+
+    for (size_t i = 0; i < builder->n_elems; i++) {
+        builder->keys[builder->order[fz_GetBucket(builder->hashes[i], n_buckets, n_dense)]++] = i;
+    }
+
+    // Bucket sizes are at most max_size, slots has room for the counts.
+    size_t* size_start = builder->slots;
+    memset(size_start, 0, (max_size + 2) * sizeof(size_t));
+
+    for (size_t b = 0; b < n_buckets; b++) {
+        size_start[max_size - (bucket_start[b + 1] - bucket_start[b]) + 1]++;
+    }
+
+    for (size_t size = 0; size <= max_size; size++) {
+        size_start[size + 1] += size_start[size];
+    }
+
+    for (size_t b = 0; b < n_buckets; b++) {
+        builder->order[size_start[max_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+    }
+}
+
+
+// Finds a pilot that sends every key of the bucket to a free slot.
+static bool fz_PlaceBucket(fz_Builder* builder, size_t bucket, uint32_t* pilot) {
+    const size_t* keys = builder->keys + builder->bucket_start[bucket];
+    size_t size = builder->bucket_start[bucket + 1] - builder->bucket_start[bucket];
+
+    // The last free slot is found in about n_elems attempts.
+    uint64_t max_pilot = 64 * (uint64_t) builder->n_elems + 1024;
+    if (max_pilot > UINT32_MAX) {
+        max_pilot = UINT32_MAX;
+    }
+
+    for (uint64_t attempt = 0; attempt <= max_pilot; attempt++) {
+        size_t n_placed = 0;
+
+        // Slots are taken right away, so two keys of the bucket can't share one.
+        for (; n_placed < size; n_placed++) {
+            size_t slot = fz_GetSlot(builder->hashes[keys[n_placed]], (uint32_t) attempt,
+                                     builder->n_elems);
+            if (fz_IsTaken(builder->taken, slot)) {
+                break;
+            }
+
+            builder->taken[slot / 64] |= 1ull << (slot % 64);
+            builder->slots[n_placed] = slot;
+        }
+
+        if (n_placed == size) {
+            *pilot = (uint32_t) attempt;
+            return true;
+        }
+
+        for (size_t i = 0; i < n_placed; i++) {
+            builder->taken[builder->slots[i] / 64] &= ~(1ull << (builder->slots[i] % 64));
+        }
+    }
+
+    return false;
+}
+
+
+static bool fz_FindPilots(fz_Builder* builder, uint32_t* pilots) {
+    fz_SortBuckets(builder);
+
+    memset(builder->taken, 0, (builder->n_elems + 63) / 64 * sizeof(uint64_t));
+
+    for (size_t i = 0; i < builder->n_buckets; i++) {
+        size_t bucket = builder->order[i];
+
+        if (builder->bucket_start[bucket] == builder->bucket_start[bucket + 1]) {
+            pilots[bucket] = 0;
+            continue;
+        }
+
+        if (!fz_PlaceBucket(builder, bucket, &pilots[bucket])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static ht_Error fz_Build(fz_FrozenTable* fz, const ht_ElemRef* elems, uint64_t* hashes) {
+    size_t n_elems   = fz->n_elems;
+    size_t n_buckets = fz->n_buckets;
+
+    fz_Builder builder = {
+        .hashes       = hashes,
+        .n_elems      = n_elems,
+        .n_buckets    = n_buckets,
+        .n_dense      = fz->n_dense,
+        .bucket_start = (size_t*)   calloc(n_buckets + 1, sizeof(size_t)),
+        .keys         = (size_t*)   calloc(n_elems + 1, sizeof(size_t)),
+        .order        = (size_t*)   calloc(n_buckets, sizeof(size_t)),
+        .taken        = (uint64_t*) calloc((n_elems + 63) / 64 + 1, sizeof(uint64_t)),
+        .slots        = (size_t*)   calloc(n_elems + 2, sizeof(size_t)),
+    };
+
+    ht_Error err = HT_ERR_MEMORY_ALLOCATION_FAILURE;
+
+    if (builder.bucket_start && builder.keys && builder.order && builder.taken &&
+        builder.slots) {
+        err = HT_ERR_PERFECT_HASH;
+
+        for (int i = 0; i < fz_gMaxSeeds; i++) {
+            fz->seed = fz_Mum((uint64_t) i ^ fz_gK0, fz_gK2);
+
+            for (size_t j = 0; j < n_elems; j++) {
+                hashes[j] = fz_Hash(elems[j].key, elems[j].len, fz->seed);
+            }
+
+            // keys is free until the pilots are searched.
+            if (fz_HashesDiffer(hashes, n_elems, (uint64_t*) builder.keys) &&
+                fz_FindPilots(&builder, fz->pilots)) {
+                err = HT_ERR_NO;
+                break;
+            }
+        }
+    }
+
+    free(builder.bucket_start);
+    free(builder.keys);
+    free(builder.order);
+    free(builder.taken);
+    free(builder.slots);
+
+    return err;
+}
+
+
+// Copies every element to its slot, long keys included.
+static ht_Error fz_Fill(fz_FrozenTable* fz, const ht_ElemRef* elems, const uint64_t* hashes) {
+    for (size_t i = 0; i < fz->n_elems; i++) {
+        size_t bucket = fz_GetBucket(hashes[i], fz->n_buckets, fz->n_dense);
+        size_t slot   = fz_GetSlot(hashes[i], fz->pilots[bucket], fz->n_elems);
+        ht_ListElem* entry = &fz->entries[slot];
+
+        *entry = *elems[i].elem;
+
+        if (!ht_SetKey(entry, elems[i].key, elems[i].len, nullptr)) {
+            return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+        }
+    }
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error fz_Contructor(fz_FrozenTable* fz, const ht_ElemRef* elems, size_t n_elems) {
+    assert(fz);
+    assert(elems || n_elems == 0);
+
+    // Small sets get a bucket per key.
+    size_t n_buckets = n_elems ? n_elems : 1;
+    if (n_elems > 16) {
+        n_buckets = (size_t) ceil(fz_gBucketFactor * (double) n_elems / log2((double) n_elems));
+    }
+
+    if (n_buckets > UINT32_MAX) {
+        return HT_ERR_PERFECT_HASH;
+    }
+
+    fz->n_elems   = n_elems;
+    fz->n_buckets = n_buckets;
+    fz->n_dense   = n_buckets * 3 / 10;
+    fz->entries   = (ht_ListElem*) calloc(n_elems + 1, sizeof(ht_ListElem));
+    fz->pilots    = (uint32_t*)    calloc(n_buckets, sizeof(uint32_t));
+
+    uint64_t* hashes = (uint64_t*) calloc(n_elems + 1, sizeof(uint64_t));
+
+    ht_Error err = HT_ERR_MEMORY_ALLOCATION_FAILURE;
+
+    if (fz->entries && fz->pilots && hashes) {
+        err = fz_Build(fz, elems, hashes);
+    }
+
+    if (!err) {
+        err = fz_Fill(fz, elems, hashes);
+    }
+
+    free(hashes);
+
+    if (err) {
+        fz_Destructor(fz);
+    }
+
+    return err;
+}
+
+
+ht_Error fz_Destructor(fz_FrozenTable* fz) {
+    assert(fz);
+
+    for (size_t i = 0; fz->entries && i < fz->n_elems; i++) {
+        ht_FreeKey(&fz->entries[i], nullptr);
+    }
+
+    free(fz->entries);
+    free(fz->pilots);
+
+    fz->entries = nullptr;
+    fz->pilots = nullptr;
+    fz->n_elems = 0;
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error fz_LookUp(const fz_FrozenTable* fz, const char* str, size_t len, size_t* value) {
+    assert(fz);
+    assert(str);
+    assert(value);
+
+    *value = 0;
+
+    if (fz->n_elems == 0) {
+        return HT_ERR_NO_SUCH_ELEMENT;
+    }
+
+    uint64_t hash   = fz_Hash(str, len, fz->seed);
+    size_t   bucket = fz_GetBucket(hash, fz->n_buckets, fz->n_dense);
+
+    const ht_ListElem* entry = &fz->entries[fz_GetSlot(hash, fz->pilots[bucket], fz->n_elems)];
+
+    if (ht_IsInlineKey(str, len)) {
+        if (!ht_InlineKeyEquals(ht_LoadKey(str, len),
+                                _mm_load_si128((const __m128i*) entry->key))) {
+            return HT_ERR_NO_SUCH_ELEMENT;
+        }
+    } else if (!ht_LongElemEquals(entry, str, len)) {
+        return HT_ERR_NO_SUCH_ELEMENT;
+    }
+
+    *value = entry->occurrences;
+    return HT_ERR_NO;
+}
+
+
+double fz_GetBitsPerKey(const fz_FrozenTable* fz) {
+    assert(fz);
+
+    if (fz->n_elems == 0) {
+        return 0;
+    }
+
+    return (double)(fz->n_buckets * sizeof(uint32_t) * 8) / (double) fz->n_elems;
+}
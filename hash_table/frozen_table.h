@@ -0,0 +1,35 @@
+#ifndef FROZEN_TABLE_H_
+#define FROZEN_TABLE_H_
+
+#include "hash_table.h"
+
+// Read-only engine made by ht_Freeze. The keys never change anymore, so a
+// minimal perfect hash (PTHash) maps every one of them to its own slot of
+// a dense array of n entries. A lookup is one hash of the key, one slot and
+// one key compare; a missing key lands in a slot of some other key.
+//
+// Keys are hashed to 64 bits and spread over n_buckets buckets, about
+// fz_gBucketFactor * n / log2(n) of them. Every bucket has a pilot: the
+// slot of a key is fastrange(hash ^ mix(pilot), n). The pilots are found
+// bucket by bucket, the biggest buckets first, while the table is empty.
+
+// Buckets per key times log2(n). More buckets build faster but take more bits.
+const double fz_gBucketFactor = 4.0;
+
+struct fz_FrozenTable {
+    ht_ListElem* entries;   // n_elems, long keys are owned
+    uint32_t*    pilots;    // n_buckets
+    size_t n_elems;
+    size_t n_buckets;
+    size_t n_dense;         // buckets [0, n_dense) get 60% of the keys
+    uint64_t seed;
+};
+
+ht_Error fz_Contructor(fz_FrozenTable* fz, const ht_ElemRef* elems, size_t n_elems);
+ht_Error fz_Destructor(fz_FrozenTable* fz);
+ht_Error fz_LookUp    (const fz_FrozenTable* fz, const char* str, size_t len, size_t* value);
+
+// Bits of the pilots per key, the entries themselves are not counted.
+double   fz_GetBitsPerKey(const fz_FrozenTable* fz);
+
+#endif
@@ -0,0 +1,77 @@
+#include "hash_key.h"
+
+// The strings are longer than 16 bytes, so the last block may overlap
+// the previous one instead of reading past the end.
+
+bool ht_LongKeyEquals_sse2(const char* a, const char* b, size_t len) {
+    size_t pos = 0;
+
+    for (; pos + 16 <= len; pos += 16) {
+        if (!ht_InlineKeyEquals(_mm_loadu_si128((const __m128i*)(a + pos)),
+                                _mm_loadu_si128((const __m128i*)(b + pos)))) {
+            return false;
+        }
+    }
+
+    if (pos == len) {
+        return true;
+    }
+
+    return ht_InlineKeyEquals(_mm_loadu_si128((const __m128i*)(a + len - 16)),
+                              _mm_loadu_si128((const __m128i*)(b + len - 16)));
+}
+
+
+__attribute__((target("avx2")))
+bool ht_LongKeyEquals_avx2(const char* a, const char* b, size_t len) {
+    size_t pos = 0;
+
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i cmp = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + pos)),
+                                       _mm256_loadu_si256((const __m256i*)(b + pos)));
+        if (!_mm256_testz_si256(cmp, cmp)) {
+            return false;
+        }
+    }
+
+    if (pos + 16 <= len) {
+        __m128i cmp = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + pos)),
+                                    _mm_loadu_si128((const __m128i*)(b + pos)));
+        if (!_mm_testz_si128(cmp, cmp)) {
+            return false;
+        }
+
+        pos += 16;
+    }
+
+    if (pos == len) {
+        return true;
+    }
+
+    __m128i cmp = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + len - 16)),
+                                _mm_loadu_si128((const __m128i*)(b + len - 16)));
+
+    return _mm_testz_si128(cmp, cmp);
+}
+
+
+// Masked loads don't fault past the end, so the tail needs no overlap.
+__attribute__((target("avx512f,avx512bw")))
+bool ht_LongKeyEquals_avx512(const char* a, const char* b, size_t len) {
+    size_t pos = 0;
+
+    for (; pos + 64 <= len; pos += 64) {
+        if (_mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a + pos), _mm512_loadu_si512(b + pos))) {
+            return false;
+        }
+    }
+
+    if (pos == len) {
+        return true;
+    }
+
+    __mmask64 tail = ~0ull >> (64 - (len - pos));
+
+    return !_mm512_mask_cmpneq_epi8_mask(tail, _mm512_maskz_loadu_epi8(tail, a + pos),
+                                         _mm512_maskz_loadu_epi8(tail, b + pos));
+}
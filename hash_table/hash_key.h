@@ -0,0 +1,166 @@
+#ifndef HASH_KEY_H_
+#define HASH_KEY_H_
+
+#include "../list/include/DLL.h"
+#include "../hash_functions/cpu_features.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+// Keys of up to 16 bytes live in ht_ListElem::key, zero-padded, and are
+// compared with one 16-byte load. Longer keys are copied out of line and
+// key holds {char* str, 7-byte length, ht_gLongKeyMarker}.
+//
+// An inline key never ends with the marker: 16-byte keys that do are
+// stored out of line too. So a 16-byte compare of an inline key can't
+// match a long element, and the short path needs no extra check.
+
+const unsigned char ht_gLongKeyMarker = 0xFF;
+
+struct ht_LongKey {
+    char* str;          // owned by the table
+    uint64_t len_marker; // len | marker << 56
+};
+
+static_assert(sizeof(ht_LongKey) == sizeof(ht_ListElem::key), "long key doesn't fit");
+
+
+inline bool ht_IsInlineKey(const char* str, size_t len) {
+    // The first comparison decides for nearly every word.
+    if (__builtin_expect(len < 16, 1)) {
+        return true;
+    }
+
+    return len == 16 && (unsigned char) str[15] != ht_gLongKeyMarker;
+}
+
+
+inline bool ht_IsLongElem(const ht_ListElem* elem) {
+    return (unsigned char) elem->key[15] == ht_gLongKeyMarker;
+}
+
+
+inline ht_LongKey ht_GetLongKey(const ht_ListElem* elem) {
+    ht_LongKey long_key = {};
+    memcpy(&long_key, elem->key, sizeof(long_key));
+
+    return long_key;
+}
+
+
+inline size_t ht_GetLongKeyLen(ht_LongKey long_key) {
+    return (size_t)(long_key.len_marker & ((1ull << 56) - 1));
+}
+
+
+// For the dumps: the key and its length, whatever the layout.
+inline const char* ht_GetKey(const ht_ListElem* elem, size_t* len) {
+    if (ht_IsLongElem(elem)) {
+        ht_LongKey long_key = ht_GetLongKey(elem);
+
+        *len = ht_GetLongKeyLen(long_key);
+        return long_key.str;
+    }
+
+    *len = strnlen(elem->key, sizeof(elem->key));
+    return elem->key;
+}
+
+
+// Inline keys only.
+inline __m128i ht_LoadKey(const char* str, size_t len) {
+    alignas(16) char zeroedStr[16] = {};
+
+    memcpy(zeroedStr, str, len);
+
+    return _mm_load_si128((const __m128i*)zeroedStr);
+}
+
+
+// Compares two inline keys. ptest needs SSE4.1, the baseline build compares
+// the bytes instead: one instruction more, not worth a dispatch.
+inline bool ht_InlineKeyEquals(__m128i a, __m128i b) {
+#ifdef __SSE4_1__
+    __m128i cmp = _mm_xor_si128(a, b);
+    return _mm_test_all_zeros(cmp, cmp);
+#else
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF;
+#endif
+}
+
+
+// Kernels of ht_LongKeyEquals, see hash_key.cpp.
+bool ht_LongKeyEquals_sse2  (const char* a, const char* b, size_t len);
+bool ht_LongKeyEquals_avx2  (const char* a, const char* b, size_t len);
+bool ht_LongKeyEquals_avx512(const char* a, const char* b, size_t len);
+
+// Both strings are longer than 16 bytes.
+inline bool ht_LongKeyEquals(const char* a, const char* b, size_t len) {
+    cpu_Level level = cpu_GetLevel();
+
+    if (level >= CPU_LEVEL_AVX512) {
+        return ht_LongKeyEquals_avx512(a, b, len);
+    }
+    if (level >= CPU_LEVEL_AVX2) {
+        return ht_LongKeyEquals_avx2(a, b, len);
+    }
+
+    return ht_LongKeyEquals_sse2(a, b, len);
+}
+
+
+inline bool ht_LongElemEquals(const ht_ListElem* elem, const char* str, size_t len) {
+    if (!ht_IsLongElem(elem)) {
+        return false;
+    }
+
+    ht_LongKey long_key = ht_GetLongKey(elem);
+
+    return ht_GetLongKeyLen(long_key) == len && ht_LongKeyEquals(long_key.str, str, len);
+}
+
+
+// Fills elem->key. Long keys are copied with the allocator, nullptr means malloc.
+inline bool ht_SetKey(ht_ListElem* elem, const char* str, size_t len,
+                      const DLL_Allocator* allocator) {
+    memset(elem->key, 0, sizeof(elem->key));
+
+    if (ht_IsInlineKey(str, len)) {
+        memcpy(elem->key, str, len);
+        return true;
+    }
+
+    char* copy = (char*)(allocator ? allocator->alloc(allocator->ctx, len) : malloc(len));
+    if (copy == nullptr) {
+        return false;
+    }
+
+    memcpy(copy, str, len);
+
+    ht_LongKey long_key = {
+        .str = copy,
+        .len_marker = (uint64_t) len | (uint64_t) ht_gLongKeyMarker << 56,
+    };
+    memcpy(elem->key, &long_key, sizeof(long_key));
+
+    return true;
+}
+
+
+inline void ht_FreeKey(ht_ListElem* elem, const DLL_Allocator* allocator) {
+    if (!ht_IsLongElem(elem)) {
+        return;
+    }
+
+    ht_LongKey long_key = ht_GetLongKey(elem);
+
+    if (allocator) {
+        allocator->free(allocator->ctx, long_key.str, ht_GetLongKeyLen(long_key));
+    } else {
+        free(long_key.str);
+    }
+}
+
+#endif
@@ -1,7 +1,16 @@
 #include "hash_table.h"
+#include "hash_table_template.h"
+#include "swiss_table.h"
+#include "table_image.h"
+#include "frozen_table.h"
+#include "arena.h"
+#include "hash_key.h"
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/random.h>
 #include "../logs/logs.h"
 
 static FILE* gLogFile = nullptr;
@@ -27,8 +36,13 @@ const char* ht_GetErrorMsg(ht_Error err) {
     #undef DEF_HT_ERR
 }
 
-inline static List* ht_GetListByString(ht_HashTable* ht, const char* str,
-                                size_t len, uint64_t* ret_hash, int* listIndex);
+// The C API is the template instantiated with the runtime hash function.
+typedef HashTable<ht_RuntimeHash, ht_ModuloBuckets> ht_RuntimeTable;
+
+
+inline static ht_RuntimeHash ht_GetRuntimeHash(const ht_HashTable* ht) {
+    return {ht->hash_function, GetHashBatch(ht->hash_function), ht->hash_seeded, ht->seed};
+}
 
 
 void ht_SetLogFile(FILE* log_file) {
@@ -37,65 +51,187 @@ void ht_SetLogFile(FILE* log_file) {
 }
 
 
-inline static List* ht_GetListByString(ht_HashTable* ht, const char* str,
-                               size_t len, uint64_t* ret_hash, int* listIndex) {
+inline static bool ht_IsReadOnly(const ht_HashTable* ht) {
+    return ht->engine == HT_ENGINE_IMAGE || ht->engine == HT_ENGINE_FROZEN;
+}
+
+
+// Only the List engine uses it, the Swiss engine always keeps its own 7/8.
+void ht_SetMaxLoadFactor(ht_HashTable* ht, float max_load_factor) {
+    assert(ht);
+    assert(max_load_factor >= 0);
+
+    ht->max_load_factor = max_load_factor;
+}
+
+
+// 0 disables reseeding, see ht_ContructorSeeded.
+void ht_SetMaxChainLen(ht_HashTable* ht, size_t max_chain_len) {
+    assert(ht);
 
-    uint64_t hash = ht->hash_function((const void*)str, len);
+    ht->max_chain_len = max_chain_len;
+}
 
-    int index = (int)(hash % ht->n_buckets);
 
-    List* list = &ht->lists[index];
+// From the kernel. If that fails, the clock and the stack address, mixed
+// by the splitmix64 finalizer.
+static uint64_t ht_GetRandomSeed() {
+    uint64_t seed = 0;
 
-    // TODO: add error check
-    if (listIndex) {
-        listLookUp16_hash(list, str, hash, len, listIndex);
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) == (ssize_t) sizeof(seed)) {
+        return seed;
     }
 
-    if (ret_hash) {
-        *ret_hash = hash;
+    seed = __rdtsc() ^ (uint64_t)(uintptr_t)&seed;
+
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+
+    return seed ^ (seed >> 31);
+}
+
+
+// Draws a new seed and rehashes every element, O(n_elems) at once.
+// If that fails, the table keeps its old seed and buckets.
+static ht_Error ht_ChangeSeed(ht_HashTable* ht) {
+    uint64_t old_seed = ht->seed;
+    ht->seed = ht_GetRandomSeed();
+
+    ht_Error err = ht_RuntimeTable::Rehash(ht, ht_GetRuntimeHash(ht));
+    if (err) {
+        ht->seed = old_seed;
+        return err;
     }
 
-    return list;
+    ht->needs_reseed = false;
+    ht->n_reseeds++;
+
+    return HT_ERR_NO;
 }
 
 
-ht_Error ht_Remove(ht_HashTable* ht, const char* str, size_t len) {
+// After an insert made a chain too long. The limit doubles every time, so
+// keys that collide under any seed can't make every insert rehash.
+static ht_Error ht_ReseedIfSeeded(ht_HashTable* ht) {
+    if (ht->hash_seeded == nullptr || ht->engine != HT_ENGINE_LIST) {
+        ht->needs_reseed = false;
+        return HT_ERR_NO;
+    }
+
+    ht->max_chain_len *= 2;
+
+    return ht_ChangeSeed(ht);
+}
+
+
+ht_Error ht_Reseed(ht_HashTable* ht) {
     assert(ht);
-    assert(str);
 
-    int listIndex = 0;
+    if (ht_IsReadOnly(ht)) {
+        DUMP_RETURN_ERROR(HT_ERR_READ_ONLY);
+    }
+
+    if (ht->hash_seeded == nullptr || ht->engine != HT_ENGINE_LIST) {
+        DUMP_RETURN_ERROR(HT_ERR_NOT_SEEDED);
+    }
+
+    ht_Error err = ht_ChangeSeed(ht);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// Only the List engine has buckets to sort.
+ht_Error ht_SetSortedBuckets(ht_HashTable* ht, bool sorted_buckets) {
+    assert(ht);
+
+    if (ht->engine != HT_ENGINE_LIST) {
+        return HT_ERR_NO;
+    }
 
-    List* list = ht_GetListByString(ht, str, len, nullptr, &listIndex);
+    ht->sorted_buckets = sorted_buckets;
 
-    // If the string is not in the list
-    if (listIndex == -1) {
-        return HT_ERR_NO_SUCH_ELEMENT;
+    if (!sorted_buckets) {
+        return HT_ERR_NO;
     }
 
-    DLL_Error err = listDelete(list, listIndex);
+    ht->reorder = HT_REORDER_NONE;
+
+    ht_Error err = ht_RuntimeTable::SortBuckets(ht);
     if (err) {
-        DUMP_RETURN_ERROR(HT_ERR_LIST);
+        DUMP_RETURN_ERROR(err);
     }
 
     return HT_ERR_NO;
 }
 
 
+// Only the List engine has buckets to reorder. The buckets stay as they
+// are, the keys move when they're found.
+ht_Error ht_SetReorder(ht_HashTable* ht, ht_Reorder reorder) {
+    assert(ht);
+
+    if (ht->engine != HT_ENGINE_LIST) {
+        return HT_ERR_NO;
+    }
+
+    ht->reorder = reorder;
+
+    if (reorder != HT_REORDER_NONE) {
+        ht->sorted_buckets = false;
+    }
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error ht_Remove(ht_HashTable* ht, const char* str, size_t len) {
+    assert(ht);
+    assert(str);
+
+    if (ht->engine == HT_ENGINE_SWISS) {
+        return st_Remove(ht->swiss, str, len, ht_Hash(ht, str, len));
+    }
+
+    if (ht_IsReadOnly(ht)) {
+        DUMP_RETURN_ERROR(HT_ERR_READ_ONLY);
+    }
+
+    ht_Error err = ht_RuntimeTable::Remove(ht, ht_GetRuntimeHash(ht), str, len);
+    if (err && err != HT_ERR_NO_SUCH_ELEMENT) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return err;
+}
+
+
 ht_Error ht_LookUp(ht_HashTable* ht, const char* str, size_t len, size_t* value) {
     assert(ht);
     assert(str);
 
-    int listIndex = 0;
-    List* list = ht_GetListByString(ht, str, len, nullptr, &listIndex);
+    if (ht->engine == HT_ENGINE_SWISS) {
+        return st_LookUp(ht->swiss, str, len, ht_Hash(ht, str, len), value);
+    }
 
-    // If the string is not in the list
-    if (listIndex == -1) {
-        *value = 0;
-        return HT_ERR_NO_SUCH_ELEMENT;
+    if (ht->engine == HT_ENGINE_IMAGE) {
+        return im_LookUp(ht->image, str, len, ht_Hash(ht, str, len), value);
     }
 
-    *value = list->data[listIndex].occurrences;
-    return HT_ERR_NO;
+    // The perfect hash has its own hash function.
+    if (ht->engine == HT_ENGINE_FROZEN) {
+        return fz_LookUp(ht->frozen, str, len, value);
+    }
+
+    ht_Error err = ht_RuntimeTable::LookUp(ht, ht_GetRuntimeHash(ht), str, len, value);
+    if (err && err != HT_ERR_NO_SUCH_ELEMENT) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return err;
 }
 
 
@@ -103,69 +239,855 @@ ht_Error ht_Insert(ht_HashTable* ht, const char* str, size_t len) {
     assert(ht);
     assert(str);
 
-    uint64_t hash = 0;
-    int listIndex = 0;
-    List* list = ht_GetListByString(ht, str, len, &hash, &listIndex);
+    ht_Error err = HT_ERR_NO;
+
+    if (ht->engine == HT_ENGINE_SWISS) {
+        err = st_Insert(ht->swiss, str, len, ht_Hash(ht, str, len));
+    } else if (ht_IsReadOnly(ht)) {
+        err = HT_ERR_READ_ONLY;
+    } else {
+        err = ht_RuntimeTable::Insert(ht, ht_GetRuntimeHash(ht), str, len);
+    }
+
+    if (!err && ht->needs_reseed) {
+        err = ht_ReseedIfSeeded(ht);
+    }
+
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// values[i] gets the occurrences of strs[i], or 0 if there's no such string.
+ht_Error ht_LookUpBatch(ht_HashTable* ht, const char* const* strs, const size_t* lens,
+                        size_t n_strs, size_t* values) {
+    assert(ht);
+    assert(strs);
+    assert(lens);
+    assert(values);
+
+    ht_Error err = HT_ERR_NO;
+
+    // Only the List engine prefetches.
+    if (ht->engine != HT_ENGINE_LIST) {
+        for (size_t i = 0; i < n_strs; i++) {
+            err = ht_LookUp(ht, strs[i], lens[i], &values[i]);
+            if (err && err != HT_ERR_NO_SUCH_ELEMENT) {
+                DUMP_RETURN_ERROR(err);
+            }
+        }
+
+        return HT_ERR_NO;
+    }
+
+    err = ht_RuntimeTable::LookUpBatch(ht, ht_GetRuntimeHash(ht), strs, lens, n_strs, values);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error ht_InsertBatch(ht_HashTable* ht, const char* const* strs, const size_t* lens,
+                        size_t n_strs) {
+    assert(ht);
+    assert(strs);
+    assert(lens);
+
+    ht_Error err = HT_ERR_NO;
+
+    if (ht->engine == HT_ENGINE_SWISS) {
+        for (size_t i = 0; i < n_strs && !err; i++) {
+            err = st_Insert(ht->swiss, strs[i], lens[i], ht_Hash(ht, strs[i], lens[i]));
+        }
+    } else if (ht_IsReadOnly(ht)) {
+        err = HT_ERR_READ_ONLY;
+    } else {
+        err = ht_RuntimeTable::InsertBatch(ht, ht_GetRuntimeHash(ht), strs, lens, n_strs);
+    }
+
+    if (!err && ht->needs_reseed) {
+        err = ht_ReseedIfSeeded(ht);
+    }
+
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+struct ht_IngestWorker {
+    ht_HashTable* ht;
+    ht_HashTable local;
+    const ht_IngestWorker* workers;
+    int n_workers;
+
+    const char* buffer;
+    bool is_text;           // NUL-separated words instead of ht_gMaxWordLen strides
+    size_t begin;           // words [begin, end) of the buffer, in bytes
+    size_t end;
+    size_t bucket_begin;    // buckets [bucket_begin, bucket_end) merged by the worker
+    size_t bucket_end;
+
+    size_t n_added;
+    ht_Error err;
+};
+
+
+// Inserts the words of [begin, end). Words of a text are read in place,
+// empty ones are skipped. Padded words go in batches, hashed together.
+static ht_Error ht_InsertWords(ht_HashTable* ht, const char* begin, const char* end,
+                               bool is_text) {
+    if (!is_text) {
+        const char* strs[ht_gBatchSize] = {};
+        size_t      lens[ht_gBatchSize] = {};
+
+        for (const char* str = begin; str < end; ) {
+            size_t count = 0;
+
+            for (; count < ht_gBatchSize && str < end; count++, str += ht_gMaxWordLen) {
+                strs[count] = str;
+                lens[count] = strnlen(str, ht_gMaxWordLen);
+            }
+
+            ht_Error err = ht_InsertBatch(ht, strs, lens, count);
+            if (err) {
+                return err;
+            }
+        }
 
-    // If the string is already in the list
-    if (listIndex != -1) {
-        list->data[listIndex].occurrences++;
         return HT_ERR_NO;
     }
 
-    ht_ListElem listElem = {
-        .str = str,
-        .hash = hash,
-        .occurrences = 1,
-    };
+    for (const char* str = begin; str < end; ) {
+        size_t len = strnlen(str, (size_t)(end - str));
+
+        if (len > 0) {
+            ht_Error err = ht_Insert(ht, str, len);
+            if (err) {
+                return err;
+            }
+        }
+
+        str += len + 1;
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// Counts the worker's part of the buffer into its own table, nothing is shared.
+static void* ht_CountWords(void* arg) {
+    ht_IngestWorker* worker = (ht_IngestWorker*) arg;
+
+    worker->err = ht_InsertWords(&worker->local, worker->buffer + worker->begin,
+                                 worker->buffer + worker->end, worker->is_text);
+
+    return nullptr;
+}
+
+
+// Moves pos forward to the start of a word.
+static size_t ht_AlignToWord(const char* text, size_t size, size_t pos) {
+    while (pos > 0 && pos < size && text[pos - 1] != '\0') {
+        pos++;
+    }
+
+    return pos;
+}
+
+
+// All the tables have the same buckets, so the worker owns its range of
+// buckets in every table and merges them without locks.
+static void* ht_MergeBuckets(void* arg) {
+    ht_IngestWorker* worker = (ht_IngestWorker*) arg;
+
+    for (int i = 0; i < worker->n_workers && !worker->err; i++) {
+        worker->err = ht_RuntimeTable::MergeBuckets(worker->ht, &worker->workers[i].local,
+                                                    worker->bucket_begin, worker->bucket_end,
+                                                    &worker->n_added);
+    }
+
+    return nullptr;
+}
+
+
+// All the buckets live in one arena, owned by the table.
+static ht_Error ht_ContructorArena(ht_HashTable* ht, size_t n_buckets, bool huge_pages,
+                                   uint64_t (*hash_function)(const void* mem, size_t size)) {
+    ar_Arena* arena = (ar_Arena*) calloc(1, sizeof(ar_Arena));
+    if (arena == nullptr) {
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    ar_Contructor(arena, huge_pages);
 
-    DLL_Error err = listPushFront(list, listElem);
+    ht_Error err = ht_RuntimeTable::Contructor(ht, n_buckets, &arena->allocator);
     if (err) {
-        DUMP_RETURN_ERROR(HT_ERR_LIST);
+        ar_Destructor(arena);
+        free(arena);
+        return err;
     }
 
+    ht->hash_function = hash_function;
+    ht->arena = arena;
+
     return HT_ERR_NO;
 }
 
 
+// Runs routine on every worker, the calling thread takes the first one.
+static ht_Error ht_RunWorkers(ht_IngestWorker* workers, pthread_t* threads, int n_workers,
+                              void* (*routine)(void* arg)) {
+    int n_started = 1;
+    for (; n_started < n_workers; n_started++) {
+        if (pthread_create(&threads[n_started], nullptr, routine, &workers[n_started])) {
+            break;
+        }
+    }
+
+    routine(&workers[0]);
+
+    for (int i = 1; i < n_started; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+
+    if (n_started != n_workers) {
+        return HT_ERR_THREAD;
+    }
+
+    for (int i = 0; i < n_workers; i++) {
+        if (workers[i].err) {
+            return workers[i].err;
+        }
+    }
+
+    return HT_ERR_NO;
+}
+
+
+static ht_Error ht_InsertParallel_internal(ht_HashTable* ht, ht_IngestWorker* workers,
+                                           pthread_t* threads, int n_workers,
+                                           const char* buffer, size_t size, bool is_text) {
+    // Buckets of a growing table move, so finish it first.
+    ht_Error err = ht_RuntimeTable::FinishRehash(ht);
+    if (err) {
+        return err;
+    }
+
+    size_t n_words = size / ht_gMaxWordLen;
+
+    // Local tables never grow: their buckets must stay the buckets of ht.
+    for (int i = 0; i < n_workers; i++) {
+        err = ht_ContructorArena(&workers[i].local, ht->n_buckets, false, ht->hash_function);
+        if (err) {
+            return err;
+        }
+
+        workers[i].local.hash_seeded = ht->hash_seeded;
+        workers[i].local.seed        = ht->seed;
+
+        workers[i].ht = ht;
+        workers[i].workers = workers;
+        workers[i].n_workers = n_workers;
+        workers[i].buffer = buffer;
+        workers[i].is_text = is_text;
+
+        if (is_text) {
+            workers[i].begin = ht_AlignToWord(buffer, size, size * (size_t) i / (size_t) n_workers);
+            workers[i].end   = ht_AlignToWord(buffer, size,
+                                              size * (size_t)(i + 1) / (size_t) n_workers);
+        } else {
+            workers[i].begin = n_words * (size_t) i       / (size_t) n_workers * ht_gMaxWordLen;
+            workers[i].end   = n_words * (size_t)(i + 1) / (size_t) n_workers * ht_gMaxWordLen;
+        }
+
+        workers[i].bucket_begin = ht->n_buckets * (size_t) i       / (size_t) n_workers;
+        workers[i].bucket_end   = ht->n_buckets * (size_t)(i + 1) / (size_t) n_workers;
+    }
+
+    err = ht_RunWorkers(workers, threads, n_workers, ht_CountWords);
+    if (err) {
+        return err;
+    }
+
+    err = ht_RunWorkers(workers, threads, n_workers, ht_MergeBuckets);
+
+    for (int i = 0; i < n_workers; i++) {
+        ht->n_elems += workers[i].n_added;
+    }
+
+    if (err) {
+        return err;
+    }
+
+    // The merge can't check the chains: n_elems is only known now.
+    ht_RuntimeTable::CheckChains(ht);
+
+    return ht_RuntimeTable::GrowIfNeeded(ht);
+}
+
+
+// Every thread counts its part of the buffer into a private table, then the
+// tables are merged into ht by bucket ranges, again in parallel.
+// The result is the same as ht_Insert of every word.
+static ht_Error ht_InsertParallel_common(ht_HashTable* ht, const char* buffer, size_t size,
+                                         int n_threads, bool is_text) {
+    assert(ht);
+    assert(buffer);
+    assert(n_threads > 0);
+
+    // Nothing to partition in the Swiss engine, the others are read-only.
+    if (ht->engine != HT_ENGINE_LIST) {
+        return ht_InsertWords(ht, buffer, buffer + size, is_text);
+    }
+
+    ht_IngestWorker* workers = (ht_IngestWorker*) calloc((size_t) n_threads,
+                                                         sizeof(ht_IngestWorker));
+    pthread_t* threads = (pthread_t*) calloc((size_t) n_threads, sizeof(pthread_t));
+
+    if (workers == nullptr || threads == nullptr) {
+        free(workers);
+        free(threads);
+        DUMP_RETURN_ERROR(HT_ERR_MEMORY_ALLOCATION_FAILURE);
+    }
+
+    ht_Error err = ht_InsertParallel_internal(ht, workers, threads, n_threads,
+                                              buffer, size, is_text);
+
+    for (int i = 0; i < n_threads; i++) {
+        if (workers[i].local.lists) {
+            ht_Destructor(&workers[i].local);
+        }
+    }
+
+    free(workers);
+    free(threads);
+
+    if (!err && ht->needs_reseed) {
+        err = ht_ReseedIfSeeded(ht);
+    }
+
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// The buffer holds words in ht_gMaxWordLen-byte strides, see ftbTransferBufferTo16.
+ht_Error ht_InsertParallel(ht_HashTable* ht, const char* buffer, size_t size, int n_threads) {
+    return ht_InsertParallel_common(ht, buffer, size, n_threads, false);
+}
+
+
+// NUL-separated words read in place, e.g. a file mapped by ftbMapFile.
+// The last word doesn't need a terminator.
+ht_Error ht_InsertTextParallel(ht_HashTable* ht, const char* text, size_t size, int n_threads) {
+    return ht_InsertParallel_common(ht, text, size, n_threads, true);
+}
+
+
 ht_Error ht_Contructor(ht_HashTable* ht, size_t n_buckets, 
                       uint64_t (*hash_function)(const void* mem, size_t size)) {
     assert(ht);
     assert(n_buckets > 0);
 
-    List* lists = (List*) calloc(n_buckets, sizeof(List));
-    if (lists == nullptr) {
-        DUMP_RETURN_ERROR(HT_ERR_LIST);
+    ht_Error err = ht_ContructorArena(ht, n_buckets, false, hash_function);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
     }
 
-    for (int i = 0; i < n_buckets; i++) {
-        DLL_Error error = listConstuctor(&lists[i]);
-        if (error) {
-            DUMP_RETURN_ERROR(HT_ERR_LIST);
-        }
+    return HT_ERR_NO;
+}
+
+
+// Same as ht_Contructor, but the arena is backed by 2 MB pages.
+ht_Error ht_ContructorHugePages(ht_HashTable* ht, size_t n_buckets,
+                               uint64_t (*hash_function)(const void* mem, size_t size)) {
+    assert(ht);
+    assert(n_buckets > 0);
+
+    ht_Error err = ht_ContructorArena(ht, n_buckets, true, hash_function);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// Same as ht_Contructor, with the hash seeded by a random seed of the table.
+ht_Error ht_ContructorSeeded(ht_HashTable* ht, size_t n_buckets,
+                       uint64_t (*hash_seeded)(const void* mem, size_t size, uint64_t seed)) {
+    assert(ht);
+    assert(n_buckets > 0);
+    assert(hash_seeded);
+
+    ht_Error err = ht_ContructorArena(ht, n_buckets, false, nullptr);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    ht->hash_seeded = hash_seeded;
+    ht->seed = ht_GetRandomSeed();
+    ht->max_chain_len = ht_gMaxChainLen;
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error ht_ContructorSwiss(ht_HashTable* ht, size_t capacity,
+                           uint64_t (*hash_function)(const void* mem, size_t size)) {
+    assert(ht);
+
+    st_SwissTable* swiss = (st_SwissTable*) calloc(1, sizeof(st_SwissTable));
+    if (swiss == nullptr) {
+        DUMP_RETURN_ERROR(HT_ERR_MEMORY_ALLOCATION_FAILURE);
+    }
+
+    ht_Error err = st_Contructor(swiss, capacity);
+    if (err) {
+        free(swiss);
+        DUMP_RETURN_ERROR(err);
     }
 
-    ht->lists = lists;
-    ht->n_buckets = n_buckets;
+    ht->lists = nullptr;
+    ht->n_buckets = 0;
     ht->hash_function = hash_function;
+    ht->engine = HT_ENGINE_SWISS;
+    ht->swiss = swiss;
+    ht->image = nullptr;
+    ht->frozen = nullptr;
+    ht->n_elems = 0;
+    ht->max_load_factor = 0;
+    ht->old_lists = nullptr;
+    ht->old_n_buckets = 0;
+    ht->rehash_index = 0;
+    ht->allocator = nullptr;
+    ht->arena = nullptr;
+    ht->hash_seeded = nullptr;
+    ht->seed = 0;
+    ht->max_chain_len = 0;
+    ht->needs_reseed = false;
+    ht->n_reseeds = 0;
+    ht->sorted_buckets = false;
+    ht->reorder = HT_REORDER_NONE;
+    ht->counters = {};
 
     return HT_ERR_NO;
 }
 
 
-ht_Error ht_Destructor(ht_HashTable* ht) {
+// Fills elems[*n_elems] if elems isn't nullptr, counts the element anyway.
+static void ht_AddElem(ht_ElemRef* elems, size_t* n_elems, const ht_ListElem* elem,
+                       const char* key, size_t len) {
+    if (elems) {
+        elems[*n_elems] = {
+            .elem = elem,
+            .key = key,
+            .len = len,
+        };
+    }
+
+    (*n_elems)++;
+}
+
+
+static void ht_AddList(const List* list, ht_ElemRef* elems, size_t* n_elems) {
+    if (list->data == nullptr) {
+        return;
+    }
+
+    for (int index = list->next[-1]; index != -1; index = list->next[index]) {
+        size_t len = 0;
+        const char* key = ht_GetKey(&list->data[index], &len);
+
+        ht_AddElem(elems, n_elems, &list->data[index], key, len);
+    }
+}
+
+
+size_t ht_ListElems(const ht_HashTable* ht, ht_ElemRef* elems) {
     assert(ht);
 
-    for (int i = 0; i < ht->n_buckets; i++) {
-        listDestructor(&ht->lists[i]);
+    size_t n_elems = 0;
+    size_t len = 0;
+    const char* key = nullptr;
+
+    switch (ht->engine) {
+        case HT_ENGINE_LIST:
+            for (size_t i = 0; i < ht->n_buckets; i++) {
+                ht_AddList(&ht->lists[i], elems, &n_elems);
+            }
+
+            for (size_t i = ht->rehash_index; ht->old_lists && i < ht->old_n_buckets; i++) {
+                ht_AddList(&ht->old_lists[i], elems, &n_elems);
+            }
+            break;
+
+        case HT_ENGINE_SWISS:
+            for (size_t i = 0; i < ht->swiss->n_groups * st_gGroupSize; i++) {
+                if (ht->swiss->ctrl[i] >= 0) {
+                    key = ht_GetKey(&ht->swiss->slots[i], &len);
+                    ht_AddElem(elems, &n_elems, &ht->swiss->slots[i], key, len);
+                }
+            }
+            break;
+
+        case HT_ENGINE_IMAGE:
+            for (size_t i = 0; i < ht->image->n_elems; i++) {
+                key = im_GetKey(ht->image, &ht->image->entries[i], &len);
+                ht_AddElem(elems, &n_elems, &ht->image->entries[i], key, len);
+            }
+            break;
+
+        case HT_ENGINE_FROZEN:
+            for (size_t i = 0; i < ht->frozen->n_elems; i++) {
+                key = ht_GetKey(&ht->frozen->entries[i], &len);
+                ht_AddElem(elems, &n_elems, &ht->frozen->entries[i], key, len);
+            }
+            break;
+
+        default:
+            assert(0 && "Unknown engine");
+            break;
     }
-    
-    free(ht->lists);
+
+    return n_elems;
+}
+
+
+// A table of any engine can be saved, an image too.
+ht_Error ht_Save(ht_HashTable* ht, FILE* file) {
+    assert(ht);
+    assert(file);
+
+    ht_Error err = im_Save(ht, file);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// One of hash_function and hash_seeded is nullptr.
+static ht_Error ht_LoadImage(ht_HashTable* ht, FILE* file,
+                             uint64_t (*hash_function)(const void* mem, size_t size),
+                             uint64_t (*hash_seeded)(const void* mem, size_t size,
+                                                     uint64_t seed)) {
+    im_Image* image = (im_Image*) calloc(1, sizeof(im_Image));
+    if (image == nullptr) {
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    uint64_t hash_id = hash_seeded ? im_GetSeededHashId(hash_seeded) : im_GetHashId(hash_function);
+
+    ht_Error err = im_Load(image, file, hash_id);
+    if (err) {
+        free(image);
+        return err;
+    }
+
+    ht->lists = nullptr;
+    ht->n_buckets = 0;
+    ht->hash_function = hash_function;
+    ht->engine = HT_ENGINE_IMAGE;
+    ht->swiss = nullptr;
+    ht->image = image;
+    ht->frozen = nullptr;
+    ht->n_elems = image->n_elems;
+    ht->max_load_factor = 0;
+    ht->old_lists = nullptr;
+    ht->old_n_buckets = 0;
+    ht->rehash_index = 0;
+    ht->allocator = nullptr;
+    ht->arena = nullptr;
+    ht->hash_seeded = hash_seeded;
+    ht->seed = image->seed;
+    ht->max_chain_len = 0;
+    ht->needs_reseed = false;
+    ht->n_reseeds = 0;
+    ht->sorted_buckets = false;
+    ht->reorder = HT_REORDER_NONE;
+    ht->counters = {};
 
     return HT_ERR_NO;
 }
 
 
+ht_Error ht_Load(ht_HashTable* ht, FILE* file,
+                 uint64_t (*hash_function)(const void* mem, size_t size)) {
+    assert(ht);
+    assert(file);
+
+    ht_Error err = ht_LoadImage(ht, file, hash_function, nullptr);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// The seed comes from the image.
+ht_Error ht_LoadSeeded(ht_HashTable* ht, FILE* file,
+                       uint64_t (*hash_seeded)(const void* mem, size_t size, uint64_t seed)) {
+    assert(ht);
+    assert(file);
+    assert(hash_seeded);
+
+    ht_Error err = ht_LoadImage(ht, file, nullptr, hash_seeded);
+    if (err) {
+        DUMP_RETURN_ERROR(err);
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// The elements are copied out of the table first, so any engine can be frozen.
+ht_Error ht_Freeze(ht_HashTable* ht) {
+    assert(ht);
+
+    if (ht->engine == HT_ENGINE_FROZEN) {
+        return HT_ERR_NO;
+    }
+
+    size_t n_elems = ht_ListElems(ht, nullptr);
+
+    ht_ElemRef* elems = (ht_ElemRef*) calloc(n_elems + 1, sizeof(ht_ElemRef));
+    fz_FrozenTable* frozen = (fz_FrozenTable*) calloc(1, sizeof(fz_FrozenTable));
+
+    if (elems == nullptr || frozen == nullptr) {
+        free(elems);
+        free(frozen);
+        DUMP_RETURN_ERROR(HT_ERR_MEMORY_ALLOCATION_FAILURE);
+    }
+
+    ht_ListElems(ht, elems);
+
+    ht_Error err = fz_Contructor(frozen, elems, n_elems);
+    free(elems);
+
+    if (err) {
+        free(frozen);
+        DUMP_RETURN_ERROR(err);
+    }
+
+    // Saving the frozen table needs the hashes of its elements.
+    uint64_t (*hash_function)(const void* mem, size_t size) = ht->hash_function;
+    uint64_t (*hash_seeded)(const void* mem, size_t size, uint64_t seed) = ht->hash_seeded;
+    uint64_t seed = ht->seed;
+
+    ht_Destructor(ht);
+
+    ht->lists = nullptr;
+    ht->n_buckets = 0;
+    ht->hash_function = hash_function;
+    ht->engine = HT_ENGINE_FROZEN;
+    ht->swiss = nullptr;
+    ht->image = nullptr;
+    ht->frozen = frozen;
+    ht->n_elems = n_elems;
+    ht->max_load_factor = 0;
+    ht->old_lists = nullptr;
+    ht->old_n_buckets = 0;
+    ht->rehash_index = 0;
+    ht->allocator = nullptr;
+    ht->arena = nullptr;
+    ht->hash_seeded = hash_seeded;
+    ht->seed = seed;
+    ht->max_chain_len = 0;
+    ht->needs_reseed = false;
+    ht->n_reseeds = 0;
+    ht->sorted_buckets = false;
+    ht->reorder = HT_REORDER_NONE;
+    ht->counters = {};
+
+    return HT_ERR_NO;
+}
+
+
+double ht_GetBitsPerKey(const ht_HashTable* ht) {
+    assert(ht);
+
+    if (ht->engine != HT_ENGINE_FROZEN) {
+        return 0;
+    }
+
+    return fz_GetBitsPerKey(ht->frozen);
+}
+
+
+// Bytes of the key out of line, 0 for an inline one.
+inline static size_t ht_GetLongKeyBytes(const ht_ListElem* elem) {
+    return ht_IsLongElem(elem) ? ht_GetLongKeyLen(ht_GetLongKey(elem)) : 0;
+}
+
+
+static void ht_AddChain(ht_Stats* stats, size_t len) {
+    stats->chain_hist[len < ht_gStatsMaxChain ? len : ht_gStatsMaxChain]++;
+
+    if (len > stats->max_chain) {
+        stats->max_chain = len;
+    }
+}
+
+
+// The bucket array entry, the element arrays and the long keys.
+static void ht_AddListStats(ht_Stats* stats, const List* list) {
+    stats->n_bytes += sizeof(List);
+
+    if (list->data == nullptr) {
+        ht_AddChain(stats, 0);
+        return;
+    }
+
+    ht_AddChain(stats, (size_t) list->listInfo.size);
+
+    // Every array has capacity + 1 entries, [-1] is the head of the list.
+    stats->n_bytes += (list->listInfo.capacity + 1) * (sizeof(ht_ListElem) + 2 * sizeof(int));
+
+    for (int index = list->next[-1]; index != -1; index = list->next[index]) {
+        stats->n_bytes += ht_GetLongKeyBytes(&list->data[index]);
+    }
+}
+
+
+void ht_GetStats(const ht_HashTable* ht, ht_Stats* stats) {
+    assert(ht);
+    assert(stats);
+
+    *stats = {};
+    stats->engine  = ht->engine;
+    stats->n_elems = ht->n_elems;
+
+    switch (ht->engine) {
+        case HT_ENGINE_LIST:
+            stats->n_buckets = ht->n_buckets;
+
+            for (size_t i = 0; i < ht->n_buckets; i++) {
+                ht_AddListStats(stats, &ht->lists[i]);
+            }
+
+            // The old buckets that haven't moved yet are chains too.
+            for (size_t i = ht->rehash_index; ht->old_lists && i < ht->old_n_buckets; i++) {
+                ht_AddListStats(stats, &ht->old_lists[i]);
+            }
+            break;
+
+        case HT_ENGINE_SWISS:
+            stats->n_elems   = ht->swiss->size;
+            stats->n_buckets = ht->swiss->n_groups * st_gGroupSize;
+            stats->n_bytes   = stats->n_buckets * (1 + sizeof(ht_ListElem));
+
+            for (size_t i = 0; i < stats->n_buckets; i++) {
+                if (ht->swiss->ctrl[i] >= 0) {
+                    ht_AddChain(stats, st_GetProbeLen(ht->swiss, i));
+                    stats->n_bytes += ht_GetLongKeyBytes(&ht->swiss->slots[i]);
+                }
+            }
+            break;
+
+        case HT_ENGINE_IMAGE:
+            stats->n_buckets = ht->image->n_buckets;
+            stats->n_bytes   = ht->image->map_size;
+
+            for (size_t i = 0; i < ht->image->n_buckets; i++) {
+                ht_AddChain(stats, (size_t)(ht->image->buckets[i + 1] - ht->image->buckets[i]));
+            }
+            break;
+
+        case HT_ENGINE_FROZEN:
+            stats->n_buckets = ht->frozen->n_elems;
+            stats->n_bytes   = ht->frozen->n_elems   * sizeof(ht_ListElem) +
+                               ht->frozen->n_buckets * sizeof(uint32_t);
+
+            for (size_t i = 0; i < ht->frozen->n_elems; i++) {
+                ht_AddChain(stats, 1);
+                stats->n_bytes += ht_GetLongKeyBytes(&ht->frozen->entries[i]);
+            }
+            break;
+
+        default:
+            assert(0 && "Unknown engine");
+            break;
+    }
+
+    if (stats->n_buckets) {
+        stats->load_factor = (double) stats->n_elems / (double) stats->n_buckets;
+    }
+
+    if (stats->n_elems) {
+        stats->bytes_per_elem = (double) stats->n_bytes / (double) stats->n_elems;
+    }
+
+#ifdef HT_STATS
+    stats->has_counters = true;
+#endif
+
+    stats->counters = ht->counters;
+
+    if (ht->counters.n_hits) {
+        stats->probes_per_hit  = (double) ht->counters.n_hit_probes  /
+                                 (double) ht->counters.n_hits;
+    }
+
+    if (ht->counters.n_misses) {
+        stats->probes_per_miss = (double) ht->counters.n_miss_probes /
+                                 (double) ht->counters.n_misses;
+    }
+}
+
+
+void ht_ResetCounters(ht_HashTable* ht) {
+    assert(ht);
+
+    ht->counters = {};
+}
+
+
+ht_Error ht_Destructor(ht_HashTable* ht) {
+    assert(ht);
+
+    if (ht->engine == HT_ENGINE_FROZEN) {
+        fz_Destructor(ht->frozen);
+        free(ht->frozen);
+        return HT_ERR_NO;
+    }
+
+    if (ht->engine == HT_ENGINE_IMAGE) {
+        im_Unload(ht->image);
+        free(ht->image);
+        return HT_ERR_NO;
+    }
+
+    if (ht->engine == HT_ENGINE_SWISS) {
+        st_Destructor(ht->swiss);
+        free(ht->swiss);
+        return HT_ERR_NO;
+    }
+
+    // Lists and bucket arrays all go away with the arena.
+    if (ht->arena) {
+        ar_Destructor(ht->arena);
+        free(ht->arena);
+        return HT_ERR_NO;
+    }
+
+    return ht_RuntimeTable::Destructor(ht);
+}
+
+
 void ht_Dump_internal(ht_HashTable* ht) {
     assert(ht);
 
@@ -173,16 +1095,83 @@ void ht_Dump_internal(ht_HashTable* ht) {
 
     fprintf(gLogFile, "\n================ HASH TABLE DUMP ================\n");
 
+    if (ht->engine == HT_ENGINE_SWISS) {
+        st_SwissTable* st = ht->swiss;
+
+        for (size_t slot = 0; slot < st->n_groups * st_gGroupSize; slot++) {
+            if (st->ctrl[slot] < 0) {
+                continue;
+            }
+
+            size_t len = 0;
+            const char* key = ht_GetKey(&st->slots[slot], &len);
+
+            fprintf(gLogFile, "\t slot %lu: \t\t%.*s (%lu)\n", slot, (int) len, key,
+                              st->slots[slot].occurrences);
+        }
+    }
+
+    if (ht->engine == HT_ENGINE_IMAGE) {
+        for (size_t entry = 0; entry < ht->image->n_elems; entry++) {
+            size_t len = 0;
+            const char* key = im_GetKey(ht->image, &ht->image->entries[entry], &len);
+
+            fprintf(gLogFile, "\t entry %lu: \t\t%.*s (%lu)\n", entry, (int) len,
+                              key ? key : "", ht->image->entries[entry].occurrences);
+        }
+    }
+
+    if (ht->engine == HT_ENGINE_FROZEN) {
+        for (size_t entry = 0; entry < ht->frozen->n_elems; entry++) {
+            size_t len = 0;
+            const char* key = ht_GetKey(&ht->frozen->entries[entry], &len);
+
+            fprintf(gLogFile, "\t slot %lu: \t\t%.*s (%lu)\n", entry, (int) len, key,
+                              ht->frozen->entries[entry].occurrences);
+        }
+    }
+
     for (size_t bucket = 0; bucket < ht->n_buckets; bucket++) {
 
         List list = ht->lists[bucket];
+        if (list.data == nullptr) {
+            continue;
+        }
+
         int current_index = list.next[-1];
 
         fprintf(gLogFile, "\t bucket %lu: \t\t", bucket);
 
         while (current_index != -1) {
-            fprintf(gLogFile, "%s (%lu) | ", list.data[current_index].str,
-                                            list.data[current_index].occurrences);
+            size_t len = 0;
+            const char* key = ht_GetKey(&list.data[current_index], &len);
+
+            fprintf(gLogFile, "%.*s (%lu) | ", (int) len, key,
+                                             list.data[current_index].occurrences);
+
+            current_index = list.next[current_index];
+        }
+
+        fprintf(gLogFile, "\n");
+    }
+
+    for (size_t bucket = ht->rehash_index; ht->old_lists && bucket < ht->old_n_buckets;
+                                                               bucket++) {
+        List list = ht->old_lists[bucket];
+        if (list.data == nullptr) {
+            continue;
+        }
+
+        int current_index = list.next[-1];
+
+        fprintf(gLogFile, "\t old bucket %lu: \t\t", bucket);
+
+        while (current_index != -1) {
+            size_t len = 0;
+            const char* key = ht_GetKey(&list.data[current_index], &len);
+
+            fprintf(gLogFile, "%.*s (%lu) | ", (int) len, key,
+                                             list.data[current_index].occurrences);
 
             current_index = list.next[current_index];
         }
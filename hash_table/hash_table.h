@@ -15,14 +15,150 @@ enum ht_Error
     #undef  DEF_HT_ERR
 };
 
+enum ht_Engine
+{
+    HT_ENGINE_LIST,   // n_buckets separate List chains
+    HT_ENGINE_SWISS,  // open addressing with SIMD control bytes, see swiss_table.h
+    HT_ENGINE_IMAGE,  // read-only, mapped from a file made by ht_Save, see table_image.h
+    HT_ENGINE_FROZEN, // read-only, minimal perfect hash made by ht_Freeze, see frozen_table.h
+};
+
+// How the List buckets move the keys that are found, see ht_SetReorder.
+enum ht_Reorder
+{
+    HT_REORDER_NONE,          // new keys go to the front, hits stay where they are
+    HT_REORDER_MOVE_TO_FRONT, // every hit goes to the front of its bucket
+    HT_REORDER_TRANSPOSE,     // every hit swaps places with the one before it
+};
+
+struct st_SwissTable;
+struct im_Image;
+struct fz_FrozenTable;
+struct ar_Arena;
+
+// Chain walks of the List engine: lookups, and the searches of inserts and
+// removes, so a new key is a miss. Only a build with HT_STATS defined
+// counts them, otherwise they stay 0 and the walks have no code for them.
+struct ht_Counters {
+    size_t n_hits;
+    size_t n_hit_probes;    // elements visited by the searches that found the key
+    size_t n_misses;
+    size_t n_miss_probes;
+    size_t n_false_matches; // the 64-bit hash matched, the key didn't
+};
+
 struct ht_HashTable {
     uint64_t (*hash_function)(const void* mem, size_t size); // expensive but beautiful
     size_t n_buckets;
     List* lists;
+    ht_Engine engine;
+    st_SwissTable* swiss;
+    im_Image* image;
+    fz_FrozenTable* frozen;
+
+    size_t n_elems;
+    float max_load_factor; // 0 disables growth
+
+    // While the table grows, buckets [rehash_index, old_n_buckets)
+    // of old_lists haven't been moved to lists yet.
+    List* old_lists;
+    size_t old_n_buckets;
+    size_t rehash_index;
+
+    // Used for the bucket arrays and the lists, nullptr means calloc/free.
+    const DLL_Allocator* allocator;
+
+    // Owns all the bucket memory if the table was made by ht_Contructor,
+    // the destructor then just unmaps it.
+    ar_Arena* arena;
+
+    // A table made by ht_ContructorSeeded hashes with hash_seeded and its
+    // own random seed, hash_function is nullptr. See ht_Hash.
+    uint64_t (*hash_seeded)(const void* mem, size_t size, uint64_t seed);
+    uint64_t seed;
+
+    // An insert that makes a chain longer than max_chain_len sets
+    // needs_reseed, and a seeded table then rehashes with a new seed.
+    // 0 disables it.
+    size_t max_chain_len;
+    bool needs_reseed;
+    size_t n_reseeds;
+
+    // Every bucket keeps its elements in the order of their hashes,
+    // see ht_SetSortedBuckets.
+    bool sorted_buckets;
+
+    // Moves the found keys toward the front, see ht_SetReorder.
+    ht_Reorder reorder;
+
+    ht_Counters counters;
 };
 
+// The hash the table keeps in its elements.
+inline uint64_t ht_Hash(const ht_HashTable* ht, const void* mem, size_t size) {
+    if (ht->hash_seeded) {
+        return ht->hash_seeded(mem, size, ht->seed);
+    }
+
+    return ht->hash_function(mem, size);
+}
+
+// Stride of the padded buffers made by ftbTransferBufferTo16. Keys passed
+// to the table itself may be longer, see hash_key.h.
 const int ht_gMaxWordLen = 16;
 
+// The number of old buckets moved by every operation while the table grows.
+const size_t ht_gRehashStep = 8;
+const size_t ht_gGrowthFactor = 2;
+
+// An element stored by any engine and its key,
+// for the engines built from another table (ht_Save, ht_Freeze).
+struct ht_ElemRef {
+    const ht_ListElem* elem;
+    const char* key;
+    size_t len;
+};
+
+// Sorted buckets at least this long are binary searched, if they're linear
+// (see DLL_ListInfo). Shorter ones are walked up to the first greater hash.
+const int ht_gSortedSearchMin = 16;
+
+// The number of strings hashed and prefetched together by the batch functions.
+const size_t ht_gBatchSize = 32;
+
+// max_chain_len of a seeded table. A chain must also be ht_gMaxChainFactor
+// times longer than the mean plus one to count: a table with a high load
+// and no growth has long chains without any attack.
+const size_t ht_gMaxChainLen    = 32;
+const size_t ht_gMaxChainFactor = 4;
+
+// Chains of ht_gStatsMaxChain elements and longer share the last
+// entry of ht_Stats::chain_hist.
+const size_t ht_gStatsMaxChain = 16;
+
+// The shape of the table, for any engine. A chain is a bucket of the List
+// and image engines, the groups probed to find an element in the Swiss one
+// and a single slot in the frozen one.
+struct ht_Stats {
+    ht_Engine engine;
+    size_t n_elems;
+    size_t n_buckets;           // slots of the Swiss and frozen engines
+    double load_factor;         // n_elems / n_buckets
+
+    size_t chain_hist[ht_gStatsMaxChain + 1]; // chains of every length, empty ones too
+    size_t max_chain;
+
+    size_t n_bytes;             // buckets, elements and long keys
+    double bytes_per_elem;
+
+    // ht_Counters since the table was made or ht_ResetCounters,
+    // has_counters is false if the build doesn't count them.
+    bool has_counters;
+    ht_Counters counters;
+    double probes_per_hit;
+    double probes_per_miss;
+};
+
 #ifndef NLOG 
     #define ht_Dump(...) ht_Dump_internal(__VA_ARGS__)
 #else
@@ -30,14 +166,77 @@ const int ht_gMaxWordLen = 16;
 #endif
 
 void     ht_SetLogFile(FILE* log_file);
+void     ht_SetMaxLoadFactor(ht_HashTable* ht, float max_load_factor);
 
 void     ht_Dump_internal  (ht_HashTable* ht);
 ht_Error ht_Remove         (ht_HashTable* ht, const char* str, size_t len);
 ht_Error ht_LookUp         (ht_HashTable* ht, const char* str, size_t len, size_t* value);
 ht_Error ht_Insert         (ht_HashTable* ht, const char* str, size_t len);
+ht_Error ht_LookUpBatch    (ht_HashTable* ht, const char* const* strs, const size_t* lens,
+                            size_t n_strs, size_t* values);
+ht_Error ht_InsertBatch    (ht_HashTable* ht, const char* const* strs, const size_t* lens,
+                            size_t n_strs);
+ht_Error ht_InsertParallel (ht_HashTable* ht, const char* buffer, size_t size,
+                            int n_threads);
+ht_Error ht_InsertTextParallel(ht_HashTable* ht, const char* text, size_t size,
+                            int n_threads);
 ht_Error ht_Destructor     (ht_HashTable* ht);
 ht_Error ht_Contructor     (ht_HashTable* ht, size_t n_buckets, 
                        uint64_t (*hash_function)(const void* mem, size_t size));
+ht_Error ht_ContructorHugePages(ht_HashTable* ht, size_t n_buckets,
+                       uint64_t (*hash_function)(const void* mem, size_t size));
+ht_Error ht_ContructorSwiss(ht_HashTable* ht, size_t capacity,
+                       uint64_t (*hash_function)(const void* mem, size_t size));
+
+// A List table hashed with a random seed of its own, e.g. HashAES_Seeded,
+// so that nobody can prepare keys that all land in one bucket. If a chain
+// still grows past max_chain_len, the insert draws a new seed and rehashes
+// the whole table, then doubles max_chain_len. Parallel inserts check every
+// chain once the merge is done.
+ht_Error ht_ContructorSeeded(ht_HashTable* ht, size_t n_buckets,
+                       uint64_t (*hash_seeded)(const void* mem, size_t size, uint64_t seed));
+void     ht_SetMaxChainLen (ht_HashTable* ht, size_t max_chain_len);
+
+// Keeps the elements of every List bucket in the order of their full hashes,
+// so a miss stops at the first greater hash instead of walking the whole
+// chain. Turning it on sorts the buckets and lays each one out as an array,
+// long ones are then binary searched. Inserts keep the layout and move
+// the greater elements up, removes break it until the next insert.
+ht_Error ht_SetSortedBuckets(ht_HashTable* ht, bool sorted_buckets);
+
+// Lets the List buckets adapt to skewed lookups, like the words of a text:
+// the keys that are found often end up at the front of their buckets.
+// Only the links of the bucket change, the elements keep their places.
+// New keys go to the back, and growth keeps the order. Lookups write to
+// the buckets, so they mustn't run concurrently. Turns sorted buckets off,
+// ht_SetSortedBuckets turns it off.
+ht_Error ht_SetReorder     (ht_HashTable* ht, ht_Reorder reorder);
+ht_Error ht_Reseed         (ht_HashTable* ht);
+
+// ht_Save writes any table to an image file. ht_Load maps it read-only
+// instead of constructing the table: lookups work right away, inserts and
+// removes return HT_ERR_READ_ONLY. hash_function must hash like the one
+// of the saved table. The file may be closed after ht_Load.
+ht_Error ht_Save           (ht_HashTable* ht, FILE* file);
+ht_Error ht_Load           (ht_HashTable* ht, FILE* file,
+                       uint64_t (*hash_function)(const void* mem, size_t size));
+ht_Error ht_LoadSeeded     (ht_HashTable* ht, FILE* file,
+                       uint64_t (*hash_seeded)(const void* mem, size_t size, uint64_t seed));
+
+// Rebuilds the table read-only around a minimal perfect hash: ht_LookUp is
+// then one hash, one slot and one key compare. Inserts and removes return
+// HT_ERR_READ_ONLY. ht_GetBitsPerKey is the size of the perfect hash,
+// 0 for the other engines.
+ht_Error ht_Freeze         (ht_HashTable* ht);
+double   ht_GetBitsPerKey  (const ht_HashTable* ht);
+
+// Walks the whole table, O(n_buckets + n_elems). Cheap enough to call now
+// and then in production builds and alert when a hash function degrades.
+void     ht_GetStats       (const ht_HashTable* ht, ht_Stats* stats);
+void     ht_ResetCounters  (ht_HashTable* ht);
+
+// Counts the elements of any engine, or lists them if elems isn't nullptr.
+size_t   ht_ListElems      (const ht_HashTable* ht, ht_ElemRef* elems);
 
 const char* ht_GetErrorMsg(ht_Error err);
 
@@ -0,0 +1,1028 @@
+#ifndef HASH_TABLE_TEMPLATE_H_
+#define HASH_TABLE_TEMPLATE_H_
+
+#include "hash_table.h"
+#include "hash_key.h"
+#include "../hash_functions/hash_functions.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+// HashTable<HashPolicy, BucketPolicy> is the List engine with the hash function
+// and the bucket reduction known at compile time, so hashing, reduction and
+// the chain walk are inlined into a single function.
+//
+// The C API (ht_Insert, ht_LookUp, ...) is HashTable<ht_RuntimeHash, ht_ModuloBuckets>
+// working on the caller's ht_HashTable.
+//
+// HashPolicy:   uint64_t operator()(const void* mem, size_t size) const
+//               void HashBatch(strs, lens, count, hashes) const  - the same for many keys
+// BucketPolicy: static size_t GetSize (size_t n_buckets)  - actual bucket count
+//               static size_t GetIndex(uint64_t hash, size_t n_buckets)
+
+
+// Calls ht_HashTable::hash_function, or hash_seeded with the seed of a
+// seeded table, like ht_Hash. That's what the C API does.
+// hash_batch is GetHashBatch(hash_function) for the batch functions.
+struct ht_RuntimeHash {
+    uint64_t (*hash_function)(const void* mem, size_t size);
+    HashBatchFunction hash_batch;
+    uint64_t (*hash_seeded)(const void* mem, size_t size, uint64_t seed);
+    uint64_t seed;
+
+    uint64_t operator()(const void* mem, size_t size) const {
+        if (hash_seeded) {
+            return hash_seeded(mem, size, seed);
+        }
+
+        return hash_function(mem, size);
+    }
+
+    void HashBatch(const char* const* strs, const size_t* lens, size_t count,
+                   uint64_t* hashes) const {
+        if (hash_batch) {
+            hash_batch(strs, lens, count, hashes);
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = (*this)(strs[i], lens[i]);
+        }
+    }
+};
+
+// Direct call of a function known at compile time.
+template <uint64_t (*HashFunction)(const void* mem, size_t size)>
+struct ht_StaticHash {
+    uint64_t operator()(const void* mem, size_t size) const {
+        return HashFunction(mem, size);
+    }
+
+    void HashBatch(const char* const* strs, const size_t* lens, size_t count,
+                   uint64_t* hashes) const {
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = HashFunction(strs[i], lens[i]);
+        }
+    }
+};
+
+// HashCRC32_inline, inlined into the table operations.
+struct ht_CRC32Hash {
+    uint64_t operator()(const void* mem, size_t size) const {
+        return HashCRC32_16(mem, size);
+    }
+
+    void HashBatch(const char* const* strs, const size_t* lens, size_t count,
+                   uint64_t* hashes) const {
+        HashCRC32_Batch(strs, lens, count, hashes);
+    }
+};
+
+
+// What a walk along a chain cost. Only filled with HT_STATS, see ht_Counters.
+struct ht_ChainWalk {
+    size_t n_probes;
+    size_t n_false_matches;
+};
+
+
+// 64-bit division, works for any number of buckets.
+struct ht_ModuloBuckets {
+    static size_t GetSize(size_t n_buckets) {
+        return n_buckets;
+    }
+
+    static size_t GetIndex(uint64_t hash, size_t n_buckets) {
+        return (size_t)(hash % n_buckets);
+    }
+};
+
+// The number of buckets is rounded up to a power of two, so the division
+// becomes a mask. Only the low bits of the hash are used.
+struct ht_PowerOfTwoBuckets {
+    static size_t GetSize(size_t n_buckets) {
+        size_t size = 1;
+        while (size < n_buckets) {
+            size *= 2;
+        }
+
+        return size;
+    }
+
+    static size_t GetIndex(uint64_t hash, size_t n_buckets) {
+        return (size_t)hash & (n_buckets - 1);
+    }
+};
+
+// Lemire's fastrange: maps a 32-bit value to [0, n_buckets) with one
+// multiplication. The hash is folded first, since CRC32 has only 32 bits.
+struct ht_FastRangeBuckets {
+    static size_t GetSize(size_t n_buckets) {
+        assert(n_buckets <= UINT32_MAX);
+        return n_buckets;
+    }
+
+    static size_t GetIndex(uint64_t hash, size_t n_buckets) {
+        uint32_t folded = (uint32_t)(hash ^ (hash >> 32));
+        return (size_t)(((uint64_t)folded * n_buckets) >> 32);
+    }
+};
+
+
+template <typename HashPolicy, typename BucketPolicy>
+class HashTable {
+  public:
+    explicit HashTable(HashPolicy hash = HashPolicy()) : ht_(), hash_(hash) {}
+
+    ht_Error Contructor(size_t n_buckets)          { return Contructor(&ht_, n_buckets); }
+    ht_Error Destructor()                          { return Destructor(&ht_); }
+    ht_Error Insert(const char* str, size_t len)   { return Insert(&ht_, hash_, str, len); }
+    ht_Error Remove(const char* str, size_t len)   { return Remove(&ht_, hash_, str, len); }
+    ht_Error LookUp(const char* str, size_t len, size_t* value) {
+        return LookUp(&ht_, hash_, str, len, value);
+    }
+    ht_Error LookUpBatch(const char* const* strs, const size_t* lens, size_t n_strs,
+                         size_t* values) {
+        return LookUpBatch(&ht_, hash_, strs, lens, n_strs, values);
+    }
+    ht_Error InsertBatch(const char* const* strs, const size_t* lens, size_t n_strs) {
+        return InsertBatch(&ht_, hash_, strs, lens, n_strs);
+    }
+
+    // For ht_SetMaxLoadFactor, ht_Dump and the statistics.
+    // Don't pass it to ht_Insert and friends: they use a different hash and reduction.
+    ht_HashTable* GetTable() { return &ht_; }
+
+
+    static ht_Error Contructor(ht_HashTable* ht, size_t n_buckets,
+                               const DLL_Allocator* allocator = nullptr) {
+        assert(ht);
+        assert(n_buckets > 0);
+
+        n_buckets = BucketPolicy::GetSize(n_buckets);
+
+        ht->allocator = allocator;
+
+        List* lists = AllocLists(ht, n_buckets);
+        if (lists == nullptr) {
+            return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+        }
+
+        for (size_t i = 0; i < n_buckets; i++) {
+            DLL_Error error = listConstuctorAlloc(&lists[i], allocator);
+            if (error) {
+                return HT_ERR_LIST;
+            }
+        }
+
+        ht->hash_function = nullptr;
+        ht->lists = lists;
+        ht->n_buckets = n_buckets;
+        ht->engine = HT_ENGINE_LIST;
+        ht->swiss = nullptr;
+        ht->image = nullptr;
+        ht->frozen = nullptr;
+        ht->n_elems = 0;
+        ht->max_load_factor = 0;
+        ht->old_lists = nullptr;
+        ht->old_n_buckets = 0;
+        ht->rehash_index = 0;
+        ht->arena = nullptr;
+        ht->hash_seeded = nullptr;
+        ht->seed = 0;
+        ht->max_chain_len = 0;
+        ht->needs_reseed = false;
+        ht->n_reseeds = 0;
+        ht->sorted_buckets = false;
+        ht->reorder = HT_REORDER_NONE;
+        ht->counters = {};
+
+        return HT_ERR_NO;
+    }
+
+
+    static ht_Error Destructor(ht_HashTable* ht) {
+        assert(ht);
+
+        for (size_t i = 0; i < ht->n_buckets; i++) {
+            FreeLongKeys(ht, &ht->lists[i]);
+            listDestructor(&ht->lists[i]);
+        }
+
+        FreeLists(ht, ht->lists, ht->n_buckets);
+
+        if (ht->old_lists) {
+            for (size_t i = ht->rehash_index; i < ht->old_n_buckets; i++) {
+                FreeLongKeys(ht, &ht->old_lists[i]);
+                listDestructor(&ht->old_lists[i]);
+            }
+
+            FreeLists(ht, ht->old_lists, ht->old_n_buckets);
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    static ht_Error Remove(ht_HashTable* ht, const HashPolicy& hash_policy,
+                           const char* str, size_t len) {
+        assert(ht);
+        assert(str);
+
+        return RemoveHashed(ht, str, len, hash_policy((const void*)str, len));
+    }
+
+
+    static ht_Error RemoveHashed(ht_HashTable* ht, const char* str, size_t len,
+                                 uint64_t hash) {
+        if (ht->old_lists) {
+            ht_Error err = RehashStep(ht);
+            if (err) {
+                return err;
+            }
+        }
+
+        ht_ChainWalk walk = {};
+
+        int listIndex = 0;
+        List* list = GetListByString(ht, str, len, hash, &listIndex, &walk);
+        CountSearch(ht, &walk, listIndex != -1);
+
+        // If the string is not in the list
+        if (listIndex == -1) {
+            return HT_ERR_NO_SUCH_ELEMENT;
+        }
+
+        ht_FreeKey(&list->data[listIndex], ht->allocator);
+
+        DLL_Error err = listDelete(list, listIndex);
+        if (err) {
+            return HT_ERR_LIST;
+        }
+
+        ht->n_elems--;
+
+        return HT_ERR_NO;
+    }
+
+
+    static ht_Error LookUp(ht_HashTable* ht, const HashPolicy& hash_policy,
+                           const char* str, size_t len, size_t* value) {
+        assert(ht);
+        assert(str);
+
+        if (ht->old_lists) {
+            ht_Error err = RehashStep(ht);
+            if (err) {
+                return err;
+            }
+        }
+
+        ht_ChainWalk walk = {};
+
+        int listIndex = 0;
+        List* list = GetListByString(ht, str, len, hash_policy((const void*)str, len),
+                                     &listIndex, &walk);
+        CountSearch(ht, &walk, listIndex != -1);
+
+        // If the string is not in the list
+        if (listIndex == -1) {
+            *value = 0;
+            return HT_ERR_NO_SUCH_ELEMENT;
+        }
+
+        *value = list->data[listIndex].occurrences;
+
+        if (Reorder(ht, list, listIndex)) {
+            return HT_ERR_LIST;
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    static ht_Error Insert(ht_HashTable* ht, const HashPolicy& hash_policy,
+                           const char* str, size_t len) {
+        assert(ht);
+        assert(str);
+
+        return InsertHashed(ht, str, len, hash_policy((const void*)str, len));
+    }
+
+
+    // Missing strings get 0 in values.
+    static ht_Error LookUpBatch(ht_HashTable* ht, const HashPolicy& hash_policy,
+                                const char* const* strs, const size_t* lens,
+                                size_t n_strs, size_t* values) {
+        assert(ht);
+        assert(strs);
+        assert(lens);
+        assert(values);
+
+        // Every lookup moves some buckets while growing, so nothing can be
+        // prefetched ahead. Growth is rare, just do it one by one.
+        if (ht->old_lists) {
+            for (size_t i = 0; i < n_strs; i++) {
+                ht_Error err = LookUp(ht, hash_policy, strs[i], lens[i], &values[i]);
+                if (err && err != HT_ERR_NO_SUCH_ELEMENT) {
+                    return err;
+                }
+            }
+
+            return HT_ERR_NO;
+        }
+
+        uint64_t hashes[ht_gBatchSize] = {};
+        List*    lists [ht_gBatchSize] = {};
+
+        for (size_t start = 0; start < n_strs; start += ht_gBatchSize) {
+            size_t count = n_strs - start < ht_gBatchSize ? n_strs - start : ht_gBatchSize;
+
+            PrefetchBatch(ht, hash_policy, strs + start, lens + start, count,
+                          hashes, lists);
+
+            for (size_t i = 0; i < count; i++) {
+                List* list = lists[i];
+
+                ht_ChainWalk walk = {};
+
+                int listIndex = -1;
+                if (list->data != nullptr) {
+                    listIndex = FindKey(list, strs[start + i], lens[start + i], hashes[i],
+                                        &walk);
+                }
+
+                CountSearch(ht, &walk, listIndex != -1);
+
+                values[start + i] = (listIndex == -1) ? 0 : list->data[listIndex].occurrences;
+
+                if (listIndex != -1 && Reorder(ht, list, listIndex)) {
+                    return HT_ERR_LIST;
+                }
+            }
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    static ht_Error InsertBatch(ht_HashTable* ht, const HashPolicy& hash_policy,
+                                const char* const* strs, const size_t* lens,
+                                size_t n_strs) {
+        assert(ht);
+        assert(strs);
+        assert(lens);
+
+        uint64_t hashes[ht_gBatchSize] = {};
+        List*    lists [ht_gBatchSize] = {};
+
+        for (size_t start = 0; start < n_strs; start += ht_gBatchSize) {
+            size_t count = n_strs - start < ht_gBatchSize ? n_strs - start : ht_gBatchSize;
+
+            PrefetchBatch(ht, hash_policy, strs + start, lens + start, count,
+                          hashes, lists);
+
+            // Inserts may start growing the table, so the buckets are looked up again.
+            for (size_t i = 0; i < count; i++) {
+                ht_Error err = InsertHashed(ht, strs[start + i], lens[start + i], hashes[i]);
+                if (err) {
+                    return err;
+                }
+            }
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    // The *Hashed functions take a hash computed by the caller.
+    static ht_Error InsertHashed(ht_HashTable* ht, const char* str, size_t len,
+                                 uint64_t hash) {
+        if (ht->old_lists) {
+            ht_Error err = RehashStep(ht);
+            if (err) {
+                return err;
+            }
+        }
+
+        ht_ChainWalk walk = {};
+
+        int listIndex = 0;
+        List* list = GetListByString(ht, str, len, hash, &listIndex, &walk);
+        CountSearch(ht, &walk, listIndex != -1);
+
+        // If the string is already in the list
+        if (listIndex != -1) {
+            list->data[listIndex].occurrences++;
+
+            if (Reorder(ht, list, listIndex)) {
+                return HT_ERR_LIST;
+            }
+
+            return HT_ERR_NO;
+        }
+
+        ht_ListElem elem = {
+            .key = {},
+            .hash = hash,
+            .occurrences = 1,
+        };
+
+        if (!ht_SetKey(&elem, str, len, ht->allocator)) {
+            return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+        }
+
+        if (AddToList(ht, list, elem)) {
+            ht_FreeKey(&elem, ht->allocator);
+            return HT_ERR_LIST;
+        }
+
+        ht->n_elems++;
+
+        if (ht->max_chain_len && IsChainTooLong(ht, list)) {
+            ht->needs_reseed = true;
+        }
+
+        return GrowIfNeeded(ht);
+    }
+
+
+    // Longer than max_chain_len and ht_gMaxChainFactor times the mean plus one.
+    static bool IsChainTooLong(const ht_HashTable* ht, const List* list) {
+        size_t len = (size_t) list->listInfo.size;
+
+        return len > ht->max_chain_len &&
+               len * ht->n_buckets > ht_gMaxChainFactor * (ht->n_elems + ht->n_buckets);
+    }
+
+
+    // After a bulk insert that didn't check its chains, such as MergeBuckets.
+    static void CheckChains(ht_HashTable* ht) {
+        for (size_t bucket = 0; ht->max_chain_len && bucket < ht->n_buckets; bucket++) {
+            if (IsChainTooLong(ht, &ht->lists[bucket])) {
+                ht->needs_reseed = true;
+                return;
+            }
+        }
+    }
+
+
+    // Moves every element to a new bucket array with the hash of hash_policy,
+    // after the seed of the table has changed. Unlike growing it stops the
+    // world: lookups couldn't find the old buckets without the old seed.
+    // Inline keys are hashed with their strnlen length, see ht_GetKey.
+    // The old buckets are kept until every element is in the new ones, so
+    // on failure the table is left as it was.
+    static ht_Error Rehash(ht_HashTable* ht, const HashPolicy& hash_policy) {
+        ht_Error err = FinishRehash(ht);
+        if (err) {
+            return err;
+        }
+
+        List* lists = AllocLists(ht, ht->n_buckets);
+        if (lists == nullptr) {
+            return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+        }
+
+        for (size_t bucket = 0; bucket < ht->n_buckets; bucket++) {
+            const List* old_list = &ht->lists[bucket];
+            if (old_list->data == nullptr) {
+                continue;
+            }
+
+            for (int index = old_list->next[-1]; index != -1; index = old_list->next[index]) {
+                ht_ListElem elem = old_list->data[index];
+
+                size_t len = 0;
+                const char* key = ht_GetKey(&elem, &len);
+                elem.hash = hash_policy((const void*)key, len);
+
+                List* list = &lists[BucketPolicy::GetIndex(elem.hash, ht->n_buckets)];
+                if (AddToList(ht, list, elem)) {
+                    // The long keys are still owned by the old buckets.
+                    DestroyLists(ht, lists, ht->n_buckets);
+                    return HT_ERR_LIST;
+                }
+            }
+        }
+
+        DestroyLists(ht, ht->lists, ht->n_buckets);
+        ht->lists = lists;
+
+        return HT_ERR_NO;
+    }
+
+
+    // Starts growing the table if the load factor is exceeded.
+    static ht_Error GrowIfNeeded(ht_HashTable* ht) {
+        if (ht->max_load_factor > 0 && ht->old_lists == nullptr &&
+            (float) ht->n_elems > ht->max_load_factor * (float) ht->n_buckets) {
+
+            return StartRehash(ht);
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    // Moves all the buckets that are still in old_lists.
+    static ht_Error FinishRehash(ht_HashTable* ht) {
+        while (ht->old_lists) {
+            ht_Error err = RehashStep(ht);
+            if (err) {
+                return err;
+            }
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    // Adds the strings of buckets [begin, end) of from to the same buckets of ht,
+    // the occurrences of strings present in both are summed. Neither table may be
+    // growing and both must have the same number of buckets, so different
+    // bucket ranges can be merged concurrently. n_elems of ht isn't updated,
+    // n_added is the number of strings that were new to ht.
+    static ht_Error MergeBuckets(ht_HashTable* ht, const ht_HashTable* from,
+                                 size_t begin, size_t end, size_t* n_added) {
+        assert(ht->n_buckets == from->n_buckets);
+        assert(ht->old_lists == nullptr && from->old_lists == nullptr);
+
+        for (size_t bucket = begin; bucket < end; bucket++) {
+            const List* from_list = &from->lists[bucket];
+            if (from_list->data == nullptr) {
+                continue;
+            }
+
+            List* list = &ht->lists[bucket];
+
+            for (int index = from_list->next[-1]; index != -1; index = from_list->next[index]) {
+                const ht_ListElem* elem = &from_list->data[index];
+                bool is_long = ht_IsLongElem(elem);
+
+                ht_LongKey long_key = ht_GetLongKey(elem);
+                size_t long_len = ht_GetLongKeyLen(long_key);
+
+                ht_ChainWalk walk = {};
+
+                int listIndex = -1;
+                if (list->data != nullptr && is_long) {
+                    listIndex = FindLongInList(list, long_key.str, long_len, elem->hash, &walk);
+                } else if (list->data != nullptr) {
+                    listIndex = FindInList(list, _mm_load_si128((const __m128i*)elem->key),
+                                           elem->hash, &walk);
+                }
+
+                if (listIndex != -1) {
+                    list->data[listIndex].occurrences += elem->occurrences;
+                    continue;
+                }
+
+                // A long key is owned by from, ht needs its own copy.
+                ht_ListElem new_elem = *elem;
+                if (is_long && !ht_SetKey(&new_elem, long_key.str, long_len, ht->allocator)) {
+                    return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+                }
+
+                if (AddToList(ht, list, new_elem)) {
+                    ht_FreeKey(&new_elem, ht->allocator);
+                    return HT_ERR_LIST;
+                }
+
+                (*n_added)++;
+            }
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    // Read-only: unlike LookUp it never moves buckets of a growing table,
+    // so it's safe to call concurrently as long as nobody modifies the table.
+    static ht_ListElem* FindHashed(ht_HashTable* ht, const char* str, size_t len,
+                                   uint64_t hash) {
+        ht_ChainWalk walk = {};
+
+        int listIndex = 0;
+        List* list = GetListByString(ht, str, len, hash, &listIndex, &walk);
+
+        return (listIndex == -1) ? nullptr : &list->data[listIndex];
+    }
+
+    // Sorts every bucket by hash and lays it out linearly, see ht_SetSortedBuckets.
+    static ht_Error SortBuckets(ht_HashTable* ht) {
+        ht_Error err = FinishRehash(ht);
+        if (err) {
+            return err;
+        }
+
+        for (size_t bucket = 0; bucket < ht->n_buckets; bucket++) {
+            List* list = &ht->lists[bucket];
+
+            if (list->data != nullptr && listSortByHash(list)) {
+                return HT_ERR_LIST;
+            }
+        }
+
+        return HT_ERR_NO;
+    }
+
+  private:
+    // Constructs a bucket made by growth on the first insert. Sorted buckets
+    // get their elements in hash order: the moved ones are mostly appended.
+    // A long one that a remove has left scattered is laid out again first,
+    // so it can be binary searched.
+    static DLL_Error AddToList(const ht_HashTable* ht, List* list, ht_ListElem elem) {
+        if (list->data == nullptr) {
+            DLL_Error err = listConstuctorAlloc(list, ht->allocator);
+            if (err) {
+                return err;
+            }
+        }
+
+        if (ht->reorder != HT_REORDER_NONE) {
+            return listPushBack(list, elem);
+        }
+
+        if (!ht->sorted_buckets) {
+            return listPushFront(list, elem);
+        }
+
+        if (!list->listInfo.isLinear && list->listInfo.size >= ht_gSortedSearchMin) {
+            DLL_Error err = listLinearize(list);
+            if (err) {
+                return err;
+            }
+        }
+
+        return listInsertSorted(list, elem);
+    }
+
+
+    // Moves a found key toward the front of its bucket, see ht_SetReorder.
+    // Its index stays the same.
+    static DLL_Error Reorder(const ht_HashTable* ht, List* list, int index) {
+        int after = list->prev[index];
+
+        switch (ht->reorder) {
+            case HT_REORDER_NONE:
+                return DLL_ERR_OK;
+
+            case HT_REORDER_MOVE_TO_FRONT:
+                return listMoveAfter(list, index, -1);
+
+            case HT_REORDER_TRANSPOSE:
+                return (after == -1) ? DLL_ERR_OK : listMoveAfter(list, index, list->prev[after]);
+
+            default:
+                assert(0 && "Unknown reorder");
+                return DLL_ERR_OK;
+        }
+    }
+
+
+    static List* AllocLists(const ht_HashTable* ht, size_t n_buckets) {
+        if (ht->allocator == nullptr) {
+            return (List*) calloc(n_buckets, sizeof(List));
+        }
+
+        return (List*) ht->allocator->alloc(ht->allocator->ctx, n_buckets * sizeof(List));
+    }
+
+
+    static void FreeLists(const ht_HashTable* ht, List* lists, size_t n_buckets) {
+        if (ht->allocator == nullptr) {
+            free(lists);
+            return;
+        }
+
+        ht->allocator->free(ht->allocator->ctx, lists, n_buckets * sizeof(List));
+    }
+
+
+    // Destructs the lists and frees the array, but not the long keys.
+    static void DestroyLists(const ht_HashTable* ht, List* lists, size_t n_buckets) {
+        for (size_t i = 0; i < n_buckets; i++) {
+            listDestructor(&lists[i]);
+        }
+
+        FreeLists(ht, lists, n_buckets);
+    }
+
+
+    static void FreeLongKeys(const ht_HashTable* ht, List* list) {
+        if (list->data == nullptr) {
+            return;
+        }
+
+        for (int index = list->next[-1]; index != -1; index = list->next[index]) {
+            ht_FreeKey(&list->data[index], ht->allocator);
+        }
+    }
+
+
+    // Hashes the whole batch first and then walks it three more times, each
+    // time prefetching the next link of bucket -> next[-1] -> data[head].
+    // This way the cache misses of all the strings are in flight at once.
+    static void PrefetchBatch(ht_HashTable* ht, const HashPolicy& hash_policy,
+                              const char* const* strs, const size_t* lens,
+                              size_t count, uint64_t* hashes, List** lists) {
+        hash_policy.HashBatch(strs, lens, count, hashes);
+
+        for (size_t i = 0; i < count; i++) {
+            lists[i] = &ht->lists[BucketPolicy::GetIndex(hashes[i], ht->n_buckets)];
+
+            _mm_prefetch((const char*)lists[i], _MM_HINT_T0);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (lists[i]->data != nullptr) {
+                _mm_prefetch((const char*)(lists[i]->next - 1), _MM_HINT_T0);
+            }
+        }
+
+        // data[-1] exists, so an empty list needs no check.
+        for (size_t i = 0; i < count; i++) {
+            if (lists[i]->data != nullptr) {
+                _mm_prefetch((const char*)&lists[i]->data[lists[i]->next[-1]], _MM_HINT_T0);
+            }
+        }
+    }
+
+
+    // Adds a search to the counters of the table. Without HT_STATS the walks
+    // are never filled, and this is empty.
+    static void CountSearch(ht_HashTable* ht, const ht_ChainWalk* walk, bool found) {
+#ifdef HT_STATS
+        ht_Counters* counters = &ht->counters;
+
+        if (found) {
+            counters->n_hits++;
+            counters->n_hit_probes += walk->n_probes;
+        } else {
+            counters->n_misses++;
+            counters->n_miss_probes += walk->n_probes;
+        }
+
+        counters->n_false_matches += walk->n_false_matches;
+#else
+        (void) ht;
+        (void) walk;
+        (void) found;
+#endif
+    }
+
+
+    static void CountProbe(ht_ChainWalk* walk) {
+#ifdef HT_STATS
+        walk->n_probes++;
+#else
+        (void) walk;
+#endif
+    }
+
+
+    static void CountFalseMatch(ht_ChainWalk* walk) {
+#ifdef HT_STATS
+        walk->n_false_matches++;
+#else
+        (void) walk;
+#endif
+    }
+
+
+    // The first element of a linear list with a hash not less than hash.
+    static int LowerBound(const List* list, uint64_t hash, ht_ChainWalk* walk) {
+        int low  = 0;
+        int high = list->listInfo.size;
+
+        while (low < high) {
+            int middle = low + (high - low) / 2;
+            CountProbe(walk);
+
+            if (list->data[middle].hash < hash) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+
+        return (low < list->listInfo.size) ? low : -1;
+    }
+
+
+    // Stops at the first greater hash. Long linear lists start from LowerBound.
+    template <typename KeyEquals>
+    static int FindInSortedList(const List* list, uint64_t hash, KeyEquals key_equals,
+                                ht_ChainWalk* walk) {
+        int index = list->next[-1];
+
+        if (list->listInfo.isLinear && list->listInfo.size >= ht_gSortedSearchMin) {
+            index = LowerBound(list, hash, walk);
+        }
+
+        while (index != -1) {
+            const ht_ListElem* elem = &list->data[index];
+            CountProbe(walk);
+
+            if (elem->hash > hash) {
+                return -1;
+            }
+
+            if (elem->hash == hash) {
+                if (key_equals(elem)) {
+                    return index;
+                }
+
+                CountFalseMatch(walk);
+            }
+
+            index = list->next[index];
+        }
+
+        return -1;
+    }
+
+
+    // listLookUp16_hash, inlined.
+    static int FindInList(const List* list, __m128i key, uint64_t hash, ht_ChainWalk* walk) {
+        if (list->listInfo.isSorted) {
+            return FindInSortedList(list, hash, [key](const ht_ListElem* elem) {
+                return ht_InlineKeyEquals(key, _mm_load_si128((const __m128i*)elem->key));
+            }, walk);
+        }
+
+        int index = list->next[-1];
+
+        while (index != -1) {
+            const ht_ListElem* elem = &list->data[index];
+            CountProbe(walk);
+
+            if (hash == elem->hash) {
+                __m128i _testStr16 = _mm_load_si128((const __m128i*)elem->key);
+
+                if (ht_InlineKeyEquals(key, _testStr16)) {
+                    return index;
+                }
+
+                CountFalseMatch(walk);
+            }
+
+            index = list->next[index];
+        }
+
+        return -1;
+    }
+
+
+    // Keys that aren't inline, see hash_key.h.
+    static int FindLongInList(const List* list, const char* str, size_t len, uint64_t hash,
+                              ht_ChainWalk* walk) {
+        if (list->listInfo.isSorted) {
+            return FindInSortedList(list, hash, [str, len](const ht_ListElem* elem) {
+                return ht_LongElemEquals(elem, str, len);
+            }, walk);
+        }
+
+        int index = list->next[-1];
+
+        while (index != -1) {
+            const ht_ListElem* elem = &list->data[index];
+            CountProbe(walk);
+
+            if (hash == elem->hash) {
+                if (ht_LongElemEquals(elem, str, len)) {
+                    return index;
+                }
+
+                CountFalseMatch(walk);
+            }
+
+            index = list->next[index];
+        }
+
+        return -1;
+    }
+
+
+    static int FindKey(const List* list, const char* str, size_t len, uint64_t hash,
+                       ht_ChainWalk* walk) {
+        if (ht_IsInlineKey(str, len)) {
+            return FindInList(list, ht_LoadKey(str, len), hash, walk);
+        }
+
+        return FindLongInList(list, str, len, hash, walk);
+    }
+
+
+    // Returns the bucket holding the string, or the bucket it should be inserted
+    // to if there's no such string (listIndex is set to -1 then).
+    // The walk covers both buckets of a growing table.
+    static List* GetListByString(ht_HashTable* ht, const char* str, size_t len,
+                                 uint64_t hash, int* listIndex, ht_ChainWalk* walk) {
+
+        // The string may still be in a bucket that hasn't been moved yet.
+        if (ht->old_lists) {
+            size_t old_index = BucketPolicy::GetIndex(hash, ht->old_n_buckets);
+            List* old_list = &ht->old_lists[old_index];
+
+            if (old_index >= ht->rehash_index && old_list->data != nullptr) {
+                *listIndex = FindKey(old_list, str, len, hash, walk);
+                if (*listIndex != -1) {
+                    return old_list;
+                }
+            }
+        }
+
+        List* list = &ht->lists[BucketPolicy::GetIndex(hash, ht->n_buckets)];
+
+        // Buckets created by growth are constructed on the first insert.
+        if (list->data == nullptr) {
+            *listIndex = -1;
+            return list;
+        }
+
+        *listIndex = FindKey(list, str, len, hash, walk);
+
+        return list;
+    }
+
+
+    static ht_Error MoveBucket(ht_HashTable* ht, List* old_list) {
+        if (old_list->data == nullptr) {
+            return HT_ERR_NO;
+        }
+
+        int index = old_list->next[-1];
+
+        while (index != -1) {
+            ht_ListElem elem = old_list->data[index];
+
+            List* list = &ht->lists[BucketPolicy::GetIndex(elem.hash, ht->n_buckets)];
+            if (AddToList(ht, list, elem)) {
+                return HT_ERR_LIST;
+            }
+
+            index = old_list->next[index];
+        }
+
+        listDestructor(old_list);
+
+        return HT_ERR_NO;
+    }
+
+
+    // Moves up to ht_gRehashStep old buckets, so growing never stops the world.
+    static ht_Error RehashStep(ht_HashTable* ht) {
+        size_t end = ht->rehash_index + ht_gRehashStep;
+        if (end > ht->old_n_buckets) {
+            end = ht->old_n_buckets;
+        }
+
+        for (; ht->rehash_index < end; ht->rehash_index++) {
+            ht_Error err = MoveBucket(ht, &ht->old_lists[ht->rehash_index]);
+            if (err) {
+                return err;
+            }
+        }
+
+        if (ht->rehash_index == ht->old_n_buckets) {
+            FreeLists(ht, ht->old_lists, ht->old_n_buckets);
+
+            ht->old_lists = nullptr;
+            ht->old_n_buckets = 0;
+            ht->rehash_index = 0;
+        }
+
+        return HT_ERR_NO;
+    }
+
+
+    // Growth factor is a power of two, so the bucket policy invariants hold.
+    static ht_Error StartRehash(ht_HashTable* ht) {
+        size_t n_buckets = ht->n_buckets * ht_gGrowthFactor;
+
+        // Lists are constructed lazily, so allocating the array is the only cost here.
+        List* lists = AllocLists(ht, n_buckets);
+        if (lists == nullptr) {
+            return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+        }
+
+        ht->old_lists = ht->lists;
+        ht->old_n_buckets = ht->n_buckets;
+        ht->rehash_index = 0;
+
+        ht->lists = lists;
+        ht->n_buckets = n_buckets;
+
+        return HT_ERR_NO;
+    }
+
+
+    ht_HashTable ht_;
+    HashPolicy hash_;
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "swiss_table.h"
+#include "hash_key.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+// Control byte values. Full slots store the 7-bit tag (0..127),
+// so the high bit set means the slot is free.
+const int8_t st_gCtrlEmpty   = (int8_t) 0x80;
+const int8_t st_gCtrlDeleted = (int8_t) 0xFE;
+
+// Max load factor is 7/8.
+inline static size_t st_MaxLoad(size_t n_groups) {
+    return n_groups * st_gGroupSize / 8 * 7;
+}
+
+
+// Hash functions in gHashFunctions don't guarantee any entropy
+// in the high bits (CRC32 is 32-bit only), so the tag and the group index
+// are taken from a mixed value.
+inline static uint64_t st_MixHash(uint64_t hash) {
+    hash ^= hash >> 29;
+    hash *= 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+
+inline static int8_t st_GetTag(uint64_t mixed) {
+    return (int8_t)(mixed & 0x7F);
+}
+
+
+inline static size_t st_GetGroup(uint64_t mixed, size_t n_groups) {
+    return (size_t)(mixed >> 7) & (n_groups - 1);
+}
+
+
+inline static uint32_t st_MatchByte(__m128i group, int8_t byte) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+}
+
+
+// Empty and deleted bytes are the only ones with the high bit set.
+inline static uint32_t st_MatchFree(__m128i group) {
+    return (uint32_t)_mm_movemask_epi8(group);
+}
+
+
+inline static __m128i st_LoadGroup(const st_SwissTable* st, size_t group) {
+    return _mm_load_si128((const __m128i*)(st->ctrl + group * st_gGroupSize));
+}
+
+
+inline static bool st_KeyEquals(const ht_ListElem* slot, __m128i key, bool is_inline,
+                                const char* str, size_t len) {
+    if (is_inline) {
+        return ht_InlineKeyEquals(key, _mm_load_si128((const __m128i*)slot->key));
+    }
+
+    return ht_LongElemEquals(slot, str, len);
+}
+
+
+static ht_ListElem* st_Find(st_SwissTable* st, const char* str, size_t len,
+                            uint64_t hash) {
+    bool is_inline = ht_IsInlineKey(str, len);
+    __m128i key = is_inline ? ht_LoadKey(str, len) : _mm_setzero_si128();
+
+    uint64_t mixed = st_MixHash(hash);
+    int8_t tag = st_GetTag(mixed);
+    size_t group = st_GetGroup(mixed, st->n_groups);
+
+    // Triangular probing visits every group when n_groups is a power of two.
+    for (size_t step = 1; ; step++) {
+        __m128i ctrl = st_LoadGroup(st, group);
+
+        uint32_t match = st_MatchByte(ctrl, tag);
+        while (match) {
+            ht_ListElem* slot = &st->slots[group * st_gGroupSize +
+                                           (size_t)__builtin_ctz(match)];
+
+            if (slot->hash == hash && st_KeyEquals(slot, key, is_inline, str, len)) {
+                return slot;
+            }
+
+            match &= match - 1;
+        }
+
+        // An empty slot terminates every probe sequence that reached it.
+        if (st_MatchByte(ctrl, st_gCtrlEmpty)) {
+            return nullptr;
+        }
+
+        group = (group + step) & (st->n_groups - 1);
+    }
+}
+
+
+// Returns the index of the first free slot in the probe sequence of the hash.
+static size_t st_FindFreeSlot(const st_SwissTable* st, uint64_t hash) {
+    size_t group = st_GetGroup(st_MixHash(hash), st->n_groups);
+
+    for (size_t step = 1; ; step++) {
+        uint32_t match = st_MatchFree(st_LoadGroup(st, group));
+        if (match) {
+            return group * st_gGroupSize + (size_t)__builtin_ctz(match);
+        }
+
+        group = (group + step) & (st->n_groups - 1);
+    }
+}
+
+
+static ht_Error st_AllocGroups(st_SwissTable* st, size_t n_groups) {
+    size_t n_slots = n_groups * st_gGroupSize;
+
+    int8_t* ctrl = (int8_t*) aligned_alloc(st_gGroupSize, n_slots);
+    if (ctrl == nullptr) {
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    ht_ListElem* slots = (ht_ListElem*) calloc(n_slots, sizeof(ht_ListElem));
+    if (slots == nullptr) {
+        free(ctrl);
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    memset(ctrl, st_gCtrlEmpty, n_slots);
+
+    st->ctrl        = ctrl;
+    st->slots       = slots;
+    st->n_groups    = n_groups;
+    st->growth_left = st_MaxLoad(n_groups) - st->size;
+
+    return HT_ERR_NO;
+}
+
+
+// Moves every element into a new array of n_groups groups,
+// dropping the tombstones on the way.
+static ht_Error st_Rehash(st_SwissTable* st, size_t n_groups) {
+    int8_t*      old_ctrl     = st->ctrl;
+    ht_ListElem* old_slots    = st->slots;
+    size_t       old_n_groups = st->n_groups;
+
+    ht_Error err = st_AllocGroups(st, n_groups);
+    if (err) {
+        return err;
+    }
+
+    for (size_t i = 0; i < old_n_groups * st_gGroupSize; i++) {
+        if (old_ctrl[i] < 0) {
+            continue;
+        }
+
+        size_t slot = st_FindFreeSlot(st, old_slots[i].hash);
+
+        st->ctrl [slot] = old_ctrl[i];
+        st->slots[slot] = old_slots[i];
+    }
+
+    free(old_ctrl);
+    free(old_slots);
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error st_Contructor(st_SwissTable* st, size_t capacity) {
+    assert(st);
+
+    size_t n_groups = 1;
+    while (st_MaxLoad(n_groups) < capacity) {
+        n_groups *= 2;
+    }
+
+    st->size = 0;
+
+    return st_AllocGroups(st, n_groups);
+}
+
+
+ht_Error st_Destructor(st_SwissTable* st) {
+    assert(st);
+
+    for (size_t i = 0; i < st->n_groups * st_gGroupSize; i++) {
+        if (st->ctrl[i] >= 0) {
+            ht_FreeKey(&st->slots[i], nullptr);
+        }
+    }
+
+    free(st->ctrl);
+    free(st->slots);
+
+    st->ctrl  = nullptr;
+    st->slots = nullptr;
+
+    return HT_ERR_NO;
+}
+
+
+// Same probe sequence as st_Find.
+size_t st_GetProbeLen(const st_SwissTable* st, size_t slot) {
+    assert(st);
+    assert(st->ctrl[slot] >= 0);
+
+    size_t group = st_GetGroup(st_MixHash(st->slots[slot].hash), st->n_groups);
+    size_t len = 1;
+
+    for (size_t step = 1; group != slot / st_gGroupSize; step++, len++) {
+        group = (group + step) & (st->n_groups - 1);
+    }
+
+    return len;
+}
+
+
+ht_Error st_LookUp(st_SwissTable* st, const char* str, size_t len, uint64_t hash,
+                   size_t* value) {
+    assert(st);
+    assert(str);
+
+    ht_ListElem* slot = st_Find(st, str, len, hash);
+    if (slot == nullptr) {
+        *value = 0;
+        return HT_ERR_NO_SUCH_ELEMENT;
+    }
+
+    *value = slot->occurrences;
+    return HT_ERR_NO;
+}
+
+
+ht_Error st_Insert(st_SwissTable* st, const char* str, size_t len, uint64_t hash) {
+    assert(st);
+    assert(str);
+
+    ht_ListElem* slot = st_Find(st, str, len, hash);
+    if (slot != nullptr) {
+        slot->occurrences++;
+        return HT_ERR_NO;
+    }
+
+    if (st->growth_left == 0) {
+        // Mostly tombstones: rehash in place, otherwise grow.
+        size_t n_groups = st->n_groups;
+        if (st->size >= st_MaxLoad(n_groups) / 2) {
+            n_groups *= 2;
+        }
+
+        ht_Error err = st_Rehash(st, n_groups);
+        if (err) {
+            return err;
+        }
+    }
+
+    ht_ListElem elem = {
+        .key = {},
+        .hash = hash,
+        .occurrences = 1,
+    };
+
+    if (!ht_SetKey(&elem, str, len, nullptr)) {
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    size_t index = st_FindFreeSlot(st, hash);
+
+    if (st->ctrl[index] == st_gCtrlEmpty) {
+        st->growth_left--;
+    }
+
+    st->ctrl[index] = st_GetTag(st_MixHash(hash));
+    st->slots[index] = elem;
+    st->size++;
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error st_Remove(st_SwissTable* st, const char* str, size_t len, uint64_t hash) {
+    assert(st);
+    assert(str);
+
+    ht_ListElem* slot = st_Find(st, str, len, hash);
+    if (slot == nullptr) {
+        return HT_ERR_NO_SUCH_ELEMENT;
+    }
+
+    ht_FreeKey(slot, nullptr);
+
+    size_t index = (size_t)(slot - st->slots);
+    size_t group = index / st_gGroupSize;
+
+    // If the group still has an empty slot, no probe sequence has ever
+    // passed through it, so the slot can become empty again.
+    if (st_MatchByte(st_LoadGroup(st, group), st_gCtrlEmpty)) {
+        st->ctrl[index] = st_gCtrlEmpty;
+        st->growth_left++;
+    } else {
+        st->ctrl[index] = st_gCtrlDeleted;
+    }
+
+    st->size--;
+
+    return HT_ERR_NO;
+}
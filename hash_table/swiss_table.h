@@ -0,0 +1,31 @@
+#ifndef SWISS_TABLE_H_
+#define SWISS_TABLE_H_
+
+#include "hash_table.h"
+
+// Open addressing engine: one control byte per slot, grouped by 16 so a whole
+// group is matched against the 7-bit hash tag with a single SSE2 compare.
+// Slots reuse ht_ListElem, so the key/hash/occurrences semantics are the same
+// as for the List buckets.
+
+const size_t st_gGroupSize = 16;
+
+struct st_SwissTable {
+    int8_t*      ctrl;   // n_groups * st_gGroupSize control bytes
+    ht_ListElem* slots;
+    size_t n_groups;     // always a power of two
+    size_t size;
+    size_t growth_left;  // free slots left before the next rehash
+};
+
+ht_Error st_Contructor(st_SwissTable* st, size_t capacity);
+ht_Error st_Destructor(st_SwissTable* st);
+ht_Error st_Insert    (st_SwissTable* st, const char* str, size_t len, uint64_t hash);
+ht_Error st_LookUp    (st_SwissTable* st, const char* str, size_t len, uint64_t hash,
+                       size_t* value);
+ht_Error st_Remove    (st_SwissTable* st, const char* str, size_t len, uint64_t hash);
+
+// The number of groups a lookup of the full slot probes, 1 for its own group.
+size_t   st_GetProbeLen(const st_SwissTable* st, size_t slot);
+
+#endif
@@ -0,0 +1,346 @@
+#include "table_image.h"
+#include "hash_table_template.h"
+#include "hash_key.h"
+#include "../file_to_buffer/fileToBuffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+const size_t im_gAlignment = 64;
+
+// Buckets are found with one multiplication, the images are built once
+// and looked up many times.
+typedef ht_FastRangeBuckets im_Buckets;
+
+inline static size_t im_Align(size_t offset) {
+    return (offset + im_gAlignment - 1) / im_gAlignment * im_gAlignment;
+}
+
+
+// Long keys of an image are offsets into its strings.
+const char* im_GetKey(const im_Image* image, const ht_ListElem* entry, size_t* len) {
+    if (!ht_IsLongElem(entry)) {
+        *len = strnlen(entry->key, sizeof(entry->key));
+        return entry->key;
+    }
+
+    im_LongKey long_key = {};
+    memcpy(&long_key, entry->key, sizeof(long_key));
+
+    *len = (size_t)(long_key.len_marker & ((1ull << 56) - 1));
+
+    // A broken image can't point out of the mapping.
+    if (long_key.offset > image->strings_size ||
+        *len > image->strings_size - long_key.offset) {
+        *len = 0;
+        return nullptr;
+    }
+
+    return image->strings + long_key.offset;
+}
+
+
+static const char* const im_gHashProbes[] = {
+    "", "a", "hash", "table", "0123456789abcdef", "a key longer than 16 bytes",
+};
+
+
+uint64_t im_GetHashId(uint64_t (*hash_function)(const void* mem, size_t size)) {
+    uint64_t id = 0;
+    for (const char* probe : im_gHashProbes) {
+        id = (id ^ hash_function(probe, strlen(probe))) * 0x9E3779B97F4A7C15ull;
+    }
+
+    return id;
+}
+
+
+// Starts from 1 instead of 0.
+uint64_t im_GetSeededHashId(uint64_t (*hash_seeded)(const void* mem, size_t size,
+                                                    uint64_t seed)) {
+    uint64_t id = 1;
+    for (const char* probe : im_gHashProbes) {
+        id = (id ^ hash_seeded(probe, strlen(probe), 0)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    return id;
+}
+
+
+static bool im_WritePadded(FILE* file, const void* data, size_t size, size_t padded_size) {
+    static const char zeros[im_gAlignment] = {};
+
+    if (size && fwrite(data, 1, size, file) != size) {
+        return false;
+    }
+
+    return padded_size == size || fwrite(zeros, 1, padded_size - size, file) == padded_size - size;
+}
+
+
+// Builds the image in memory: a bucket directory and the entries
+// ordered by bucket, with long keys moved to the string area.
+static ht_Error im_Build(const ht_ElemRef* sources, size_t n_elems, size_t n_buckets,
+                         uint64_t* buckets, ht_ListElem* entries, char* strings) {
+    for (size_t i = 0; i < n_elems; i++) {
+        buckets[im_Buckets::GetIndex(sources[i].elem->hash, n_buckets) + 1]++;
+    }
+
+    for (size_t i = 0; i < n_buckets; i++) {
+        buckets[i + 1] += buckets[i];
+    }
+
+    uint64_t* cursors = (uint64_t*) malloc(n_buckets * sizeof(uint64_t));
+    if (cursors == nullptr) {
+        return HT_ERR_MEMORY_ALLOCATION_FAILURE;
+    }
+
+    memcpy(cursors, buckets, n_buckets * sizeof(uint64_t));
+
+    size_t strings_size = 0;
+
+    for (size_t i = 0; i < n_elems; i++) {
+        const ht_ElemRef* source = &sources[i];
+        size_t bucket = im_Buckets::GetIndex(source->elem->hash, n_buckets);
+        ht_ListElem* entry = &entries[cursors[bucket]++];
+
+        *entry = *source->elem;
+
+        if (!ht_IsLongElem(source->elem)) {
+            continue;
+        }
+
+        if (source->len) {
+            memcpy(strings + strings_size, source->key, source->len);
+        }
+
+        im_LongKey long_key = {
+            .offset = strings_size,
+            .len_marker = (uint64_t) source->len | (uint64_t) ht_gLongKeyMarker << 56,
+        };
+        memcpy(entry->key, &long_key, sizeof(long_key));
+
+        strings_size += source->len;
+    }
+
+    free(cursors);
+
+    return HT_ERR_NO;
+}
+
+
+static ht_Error im_Write(FILE* file, const im_Header* header, const uint64_t* buckets,
+                         const ht_ListElem* entries, const char* strings) {
+    size_t buckets_size = (header->n_buckets + 1) * sizeof(uint64_t);
+    size_t entries_size = header->n_elems * sizeof(ht_ListElem);
+
+    bool ok = im_WritePadded(file, header, sizeof(*header), header->buckets_offset) &&
+              im_WritePadded(file, buckets, buckets_size,
+                             header->entries_offset - header->buckets_offset) &&
+              im_WritePadded(file, entries, entries_size,
+                             header->strings_offset - header->entries_offset) &&
+              im_WritePadded(file, strings, header->strings_size, header->strings_size);
+
+    if (!ok || fflush(file) != 0) {
+        return HT_ERR_FILE;
+    }
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error im_Save(const ht_HashTable* ht, FILE* file) {
+    assert(ht);
+    assert(file);
+
+    size_t n_elems = ht_ListElems(ht, nullptr);
+
+    // About one entry per bucket, so a lookup reads one or two entries.
+    size_t n_buckets = n_elems ? n_elems : 1;
+    if (n_buckets > UINT32_MAX) {
+        n_buckets = UINT32_MAX;
+    }
+
+    ht_ElemRef*  sources = (ht_ElemRef*)  calloc(n_elems + 1, sizeof(ht_ElemRef));
+    uint64_t*    buckets = (uint64_t*)    calloc(n_buckets + 1, sizeof(uint64_t));
+    ht_ListElem* entries = (ht_ListElem*) calloc(n_elems + 1, sizeof(ht_ListElem));
+    char*        strings = nullptr;
+
+    ht_Error err = HT_ERR_MEMORY_ALLOCATION_FAILURE;
+
+    if (sources && buckets && entries) {
+        ht_ListElems(ht, sources);
+
+        size_t strings_size = 0;
+        for (size_t i = 0; i < n_elems; i++) {
+            if (ht_IsLongElem(sources[i].elem)) {
+                strings_size += sources[i].len;
+            }
+        }
+
+        strings = (char*) malloc(strings_size + 1);
+
+        if (strings) {
+            err = im_Build(sources, n_elems, n_buckets, buckets, entries, strings);
+        }
+
+        if (!err) {
+            im_Header header = {};
+
+            memcpy(header.magic, im_gMagic, sizeof(header.magic));
+            header.version        = im_gVersion;
+            header.elem_size      = sizeof(ht_ListElem);
+            header.hash_id        = ht->hash_seeded ? im_GetSeededHashId(ht->hash_seeded) :
+                                                    im_GetHashId(ht->hash_function);
+            header.n_buckets      = n_buckets;
+            header.n_elems        = n_elems;
+            header.buckets_offset = im_Align(sizeof(header));
+            header.entries_offset = im_Align(header.buckets_offset +
+                                             (n_buckets + 1) * sizeof(uint64_t));
+            header.strings_offset = im_Align(header.entries_offset +
+                                             n_elems * sizeof(ht_ListElem));
+            header.strings_size   = strings_size;
+            header.hash_seed      = ht->hash_seeded ? ht->seed : 0;
+
+            err = im_Write(file, &header, buckets, entries, strings);
+        }
+    }
+
+    free(sources);
+    free(buckets);
+    free(entries);
+    free(strings);
+
+    return err;
+}
+
+
+// [offset, offset + count * size) lies inside the file, without overflows.
+inline static bool im_RangeFits(uint64_t offset, uint64_t count, size_t size, size_t file_size) {
+    return count <= file_size / size && offset <= file_size - count * size;
+}
+
+
+static ht_Error im_Check(const im_Header* header, size_t size, uint64_t hash_id) {
+    if (memcmp(header->magic, im_gMagic, sizeof(im_gMagic)) != 0 ||
+        header->version != im_gVersion || header->elem_size != sizeof(ht_ListElem)) {
+        return HT_ERR_BAD_IMAGE;
+    }
+
+    if (header->n_buckets == 0 || header->n_buckets > UINT32_MAX ||
+        header->buckets_offset % alignof(uint64_t)    != 0 ||
+        header->entries_offset % alignof(ht_ListElem) != 0 ||
+        !im_RangeFits(header->buckets_offset, header->n_buckets + 1, sizeof(uint64_t), size) ||
+        !im_RangeFits(header->entries_offset, header->n_elems, sizeof(ht_ListElem), size) ||
+        !im_RangeFits(header->strings_offset, header->strings_size, 1, size)) {
+        return HT_ERR_BAD_IMAGE;
+    }
+
+    if (header->hash_id != hash_id) {
+        return HT_ERR_HASH_MISMATCH;
+    }
+
+    return HT_ERR_NO;
+}
+
+
+// Only the header is read here, the rest is paged in by the lookups.
+// hash_id is im_GetHashId or im_GetSeededHashId of the hash to look up with.
+ht_Error im_Load(im_Image* image, FILE* file, uint64_t hash_id) {
+    assert(image);
+    assert(file);
+
+    size_t size = 0;
+    const char* map = ftbMapFile(&size, file, FTB_MAP_DEFAULT);
+    if (map == nullptr) {
+        return HT_ERR_FILE;
+    }
+
+    if (size < sizeof(im_Header)) {
+        ftbUnmapFile(map, size);
+        return HT_ERR_BAD_IMAGE;
+    }
+
+    const im_Header* header = (const im_Header*) map;
+
+    ht_Error err = im_Check(header, size, hash_id);
+    if (err) {
+        ftbUnmapFile(map, size);
+        return err;
+    }
+
+    image->map          = map;
+    image->map_size     = size;
+    image->buckets      = (const uint64_t*)    (map + header->buckets_offset);
+    image->entries      = (const ht_ListElem*) (map + header->entries_offset);
+    image->strings      = map + header->strings_offset;
+    image->n_buckets    = header->n_buckets;
+    image->n_elems      = header->n_elems;
+    image->strings_size = header->strings_size;
+    image->seed         = header->hash_seed;
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error im_Unload(im_Image* image) {
+    assert(image);
+
+    ftbUnmapFile(image->map, image->map_size);
+
+    image->map = nullptr;
+    image->map_size = 0;
+
+    return HT_ERR_NO;
+}
+
+
+ht_Error im_LookUp(const im_Image* image, const char* str, size_t len, uint64_t hash,
+                   size_t* value) {
+    assert(image);
+    assert(str);
+    assert(value);
+
+    size_t bucket = im_Buckets::GetIndex(hash, image->n_buckets);
+
+    // The directory isn't checked on load, clamp it instead.
+    uint64_t end   = image->buckets[bucket + 1];
+    uint64_t begin = image->buckets[bucket];
+
+    if (end > image->n_elems) {
+        end = image->n_elems;
+    }
+
+    bool is_inline = ht_IsInlineKey(str, len);
+    __m128i key = is_inline ? ht_LoadKey(str, len) : _mm_setzero_si128();
+
+    for (uint64_t i = begin; i < end; i++) {
+        const ht_ListElem* entry = &image->entries[i];
+
+        if (entry->hash != hash) {
+            continue;
+        }
+
+        if (is_inline) {
+            if (!ht_InlineKeyEquals(key, _mm_load_si128((const __m128i*) entry->key))) {
+                continue;
+            }
+        } else {
+            size_t entry_len = 0;
+            const char* entry_key = im_GetKey(image, entry, &entry_len);
+
+            if (!ht_IsLongElem(entry) || entry_key == nullptr || entry_len != len ||
+                !ht_LongKeyEquals(entry_key, str, len)) {
+                continue;
+            }
+        }
+
+        *value = entry->occurrences;
+        return HT_ERR_NO;
+    }
+
+    *value = 0;
+    return HT_ERR_NO_SUCH_ELEMENT;
+}
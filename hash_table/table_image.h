@@ -0,0 +1,77 @@
+#ifndef TABLE_IMAGE_H_
+#define TABLE_IMAGE_H_
+
+#include "hash_table.h"
+
+// Read-only engine served straight from a file written by ht_Save.
+// The image has no pointers, only offsets from its start, so it's mapped
+// as is and nothing is built on load: pages are read on the first lookup
+// that touches them.
+//
+// Layout, every part aligned to 64 bytes:
+//   im_Header
+//   uint64_t buckets[n_buckets + 1]  entries of bucket b are [buckets[b], buckets[b + 1])
+//   ht_ListElem entries[n_elems]     grouped by bucket, see below
+//   char strings[strings_size]       long keys
+//
+// The bucket of a hash is fastrange of its folded halves, as in
+// ht_FastRangeBuckets: ((uint32_t)(hash ^ (hash >> 32)) * n_buckets) >> 32.
+//
+// Entries have the ht_ListElem layout. A long key holds im_LongKey, an offset
+// into strings instead of a pointer.
+
+const char     im_gMagic[8] = {'H', 'T', 'I', 'M', 'A', 'G', 'E', '\0'};
+const uint32_t im_gVersion  = 1;
+
+struct alignas(64) im_Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t elem_size;     // sizeof(ht_ListElem), the image is not portable
+    uint64_t hash_id;       // see im_GetHashId
+    uint64_t n_buckets;
+    uint64_t n_elems;
+    uint64_t buckets_offset;
+    uint64_t entries_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t hash_seed;     // of a seeded table, see im_GetSeededHashId
+};
+
+struct im_LongKey {
+    uint64_t offset;        // into strings
+    uint64_t len_marker;    // same as ht_LongKey
+};
+
+struct im_Image {
+    const char* map;
+    size_t map_size;
+
+    const uint64_t*    buckets;
+    const ht_ListElem* entries;
+    const char*        strings;
+
+    size_t n_buckets;
+    size_t n_elems;
+    size_t strings_size;
+    uint64_t seed;
+};
+
+// Hashes of a few fixed keys. It's the same for two functions only if they
+// hash the same way, so the id survives rebuilds and address randomization.
+uint64_t im_GetHashId(uint64_t (*hash_function)(const void* mem, size_t size));
+
+// The same for a seeded function, with seed 0 and another start, so that it
+// doesn't match the unseeded ones. The seed of the table is saved apart.
+uint64_t im_GetSeededHashId(uint64_t (*hash_seeded)(const void* mem, size_t size,
+                                                    uint64_t seed));
+
+ht_Error im_Save    (const ht_HashTable* ht, FILE* file);
+ht_Error im_Load    (im_Image* image, FILE* file, uint64_t hash_id);
+ht_Error im_Unload  (im_Image* image);
+ht_Error im_LookUp  (const im_Image* image, const char* str, size_t len, uint64_t hash,
+                     size_t* value);
+
+// The key of an entry, nullptr if a long key points out of the image.
+const char* im_GetKey(const im_Image* image, const ht_ListElem* entry, size_t* len);
+
+#endif
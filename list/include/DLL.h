@@ -15,20 +15,32 @@ enum DLL_Error
 
 typedef int ht_valueElem;
 
+// The key is stored inline, zero-padded, so comparing it touches the same
+// cache line as the hash and the input buffer may be freed after inserting.
 struct ht_ListElem
 {
-    const char*    str;
+    alignas(16) char key[16];
     uint64_t      hash;
     size_t occurrences;
 };
 
 typedef ht_ListElem listElem; // FIXME: cringe obv
 
+// Lets the owner of the list decide where the arrays live and when
+// they're actually freed. nullptr means calloc/realloc/free.
+struct DLL_Allocator
+{
+    void* (*alloc)(void* ctx, size_t size);           // must return zeroed memory
+    void  (*free) (void* ctx, void* ptr, size_t size);
+    void* ctx;
+};
+
 struct DLL_ListInfo
 {
     unsigned int capacity; 
     int size;
-    bool isSorted;
+    bool isSorted;  // hashes don't decrease along next[]
+    bool isLinear;  // the list is data[0], data[1], ... data[size - 1], in this order
 };
 
 struct List
@@ -39,10 +51,12 @@ struct List
     int free;
     DLL_ListInfo listInfo;
     FILE* logFile;
+    const DLL_Allocator* allocator;
 };
 
 void      listSetLogFile    (FILE* file);
 DLL_Error listConstuctor    (List* list);
+DLL_Error listConstuctorAlloc(List* list, const DLL_Allocator* allocator);
 DLL_Error listDestructor    (List* list);
 DLL_Error listVerify        (List* list);
 DLL_Error listDelete        (List* list, int index);
@@ -50,8 +64,11 @@ DLL_Error listInsertAfter   (List* list, int index, listElem value);
 DLL_Error listInsertBefore  (List* list, int index, listElem value);
 DLL_Error listPushFront     (List* list, listElem value);
 DLL_Error listPushBack      (List* list, listElem value);
+DLL_Error listMoveAfter     (List* list, int index, int after);
 DLL_Error listChangeCapacity(List* list, float multiplier);
 DLL_Error listLinearize     (List* list);
+DLL_Error listInsertSorted  (List* list, listElem value);
+DLL_Error listSortByHash    (List* list);
 DLL_Error listLookUp        (List* list, const char* str, size_t len, int* value);
 DLL_Error listLookUp16      (List* list, const char* str, size_t len, int* value);
 DLL_Error listLookUp16_hash (List* list, const char* str, uint64_t hash, size_t len, int* value);
@@ -68,28 +68,67 @@ DLL_Error listVerify(List* list)
 }
 
 
-static DLL_Error allocListMem(listElem** data, int** prev, int** next, unsigned int capacity)
+static void* listAlloc(const DLL_Allocator* allocator, size_t size)
+{
+    if (allocator == NULL)
+        return calloc(size, 1);
+
+    return allocator->alloc(allocator->ctx, size);
+}
+
+
+static void listFree(const DLL_Allocator* allocator, void* ptr, size_t size)
+{
+    if (allocator == NULL)
+    {
+        free(ptr);
+        return;
+    }
+
+    allocator->free(allocator->ctx, ptr, size);
+}
+
+
+// The old block goes through allocator->free, so the owner may defer it.
+static void* listRealloc(const DLL_Allocator* allocator, void* ptr, size_t oldSize, size_t newSize)
+{
+    if (allocator == NULL)
+        return realloc(ptr, newSize);
+
+    void* newPtr = allocator->alloc(allocator->ctx, newSize);
+    if (newPtr == NULL)
+        return NULL;
+
+    memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+    allocator->free(allocator->ctx, ptr, oldSize);
+
+    return newPtr;
+}
+
+
+static DLL_Error allocListMem(const DLL_Allocator* allocator,
+                              listElem** data, int** prev, int** next, unsigned int capacity)
 {
     LOGF(logFile, "allocListMem() started\n");
 
-    *data = (listElem*) calloc(sizeof(*data[0]), capacity + 1);
-    if (data == NULL)
+    *data = (listElem*) listAlloc(allocator, sizeof(*data[0]) * (capacity + 1));
+    if (*data == NULL)
     {
         DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
     }
 
-    *prev = (int*) calloc(sizeof(*prev[0]), capacity + 1);
-    if (prev == NULL)
+    *prev = (int*) listAlloc(allocator, sizeof(*prev[0]) * (capacity + 1));
+    if (*prev == NULL)
     {
-        free(data);
+        listFree(allocator, *data, sizeof(*data[0]) * (capacity + 1));
         DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
     }
 
-    *next = (int*) calloc(sizeof(*next[0]), capacity + 1);
-    if (next == NULL)
+    *next = (int*) listAlloc(allocator, sizeof(*next[0]) * (capacity + 1));
+    if (*next == NULL)
     {
-        free(data);
-        free(prev);
+        listFree(allocator, *data, sizeof(*data[0]) * (capacity + 1));
+        listFree(allocator, *prev, sizeof(*prev[0]) * (capacity + 1));
         DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
     }
 
@@ -101,6 +140,16 @@ static DLL_Error allocListMem(listElem** data, int** prev, int** next, unsigned
 }
 
 
+static void freeListMem(List* list)
+{
+    size_t n_elems = list->listInfo.capacity + 1;
+
+    listFree(list->allocator, list->next - 1, sizeof(int)      * n_elems);
+    listFree(list->allocator, list->prev - 1, sizeof(int)      * n_elems);
+    listFree(list->allocator, list->data - 1, sizeof(listElem) * n_elems);
+}
+
+
 void listSetLogFile(FILE* file) 
 {
     logFile = file;
@@ -108,6 +157,12 @@ void listSetLogFile(FILE* file)
 
 
 DLL_Error listConstuctor(List* list)
+{
+    return listConstuctorAlloc(list, NULL);
+}
+
+
+DLL_Error listConstuctorAlloc(List* list, const DLL_Allocator* allocator)
 {
     LOGF(logFile, "listConstuctor() started.\n");
 
@@ -115,8 +170,10 @@ DLL_Error listConstuctor(List* list)
         DUMP_AND_RETURN_ERROR(DLL_ERR_NULL_LIST_PASSED);
 
     list->logFile = logFile;
+    list->allocator = allocator;
 
-    if (allocListMem(&list->data, &list->prev, &list->next, DLL_DEFAULT_CAPACITY) != DLL_ERR_OK)
+    if (allocListMem(allocator, &list->data, &list->prev, &list->next,
+                     DLL_DEFAULT_CAPACITY) != DLL_ERR_OK)
         return DLL_ERR_MEMORY_ALLOCATION_FAILURE;
 
     // Fill in arrays with info.
@@ -134,6 +191,7 @@ DLL_Error listConstuctor(List* list)
     list->listInfo.capacity = DLL_DEFAULT_CAPACITY;
     list->listInfo.size     = 0;
     list->listInfo.isSorted = true;
+    list->listInfo.isLinear = true;
 
     LOGF(logFile, "listConstuctor() success.\n");
     return DLL_ERR_OK;
@@ -146,14 +204,12 @@ DLL_Error listDestructor(List* list)
     if (list == NULL) 
         DUMP_AND_RETURN_ERROR(DLL_ERR_NULL_LIST_PASSED);
 
-    if (list->next != NULL)
-        free(list->next - 1);
-
-    if (list->prev != NULL)
-        free(list->prev - 1);
-
     if (list->data != NULL)
-        free(list->data - 1);
+        freeListMem(list);
+
+    list->data = NULL;
+    list->prev = NULL;
+    list->next = NULL;
 
     LOGF(logFile, "listDestructor() success.\n");
 
@@ -166,13 +222,17 @@ DLL_Error listDelete(List* list, int index)
     LOGF(logFile, "listDelete(%d) started.\n", index);
     if (list == NULL)
         DUMP_AND_RETURN_ERROR(DLL_ERR_NULL_LIST_PASSED);
-    if (index <= 0)
+    if (index < 0)
         DUMP_AND_RETURN_ERROR(DLL_ERR_INVALID_INDEX_PASSED);
     VERIFY_DUMP_RETURN_ERROR(list);
 
     int indPrev = list->prev[index];
     int indNext = list->next[index];
 
+    // The freed slot is the next one taken, so removing the tail keeps it linear.
+    if (index != list->listInfo.size - 1 || indNext != -1)
+        list->listInfo.isLinear = false;
+
     list->prev[index] = DLL_PREV_POISON;
     list->next[index] = list->free;
 
@@ -194,12 +254,16 @@ DLL_Error listInsertAfter(List* list, int index, listElem value)
         DUMP_AND_RETURN_ERROR(DLL_ERR_NULL_LIST_PASSED);
     VERIFY_DUMP_RETURN_ERROR(list);
 
-    if (list->free >= (int) list->listInfo.capacity - 1)
-        listChangeCapacity(list, DLL_CAPACITY_MULTIPLIER);
+    if (list->free >= (int) list->listInfo.capacity - 1 &&
+        listChangeCapacity(list, DLL_CAPACITY_MULTIPLIER))
+        DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
 
     int freeIndex = list->free;
     list->free = list->next[freeIndex];
 
+    if (freeIndex != list->listInfo.size || index != list->listInfo.size - 1)
+        list->listInfo.isLinear = false;
+
     list->listInfo.size++;
 
     list->data[freeIndex] = value;
@@ -214,6 +278,13 @@ DLL_Error listInsertAfter(List* list, int index, listElem value)
         list->prev[freeIndex] = -1;
         LOGF_COLOR(logFile, green, "TAIL: %d\n", list->prev[-1]);
     }
+
+    int indPrev = list->prev[freeIndex];
+    int indNext = list->next[freeIndex];
+
+    if ((indPrev != -1 && list->data[indPrev].hash > value.hash) ||
+        (indNext != -1 && list->data[indNext].hash < value.hash))
+        list->listInfo.isSorted = false;
     LOGF_COLOR(logFile, green, "FREE: %d\n", list->free);
 
     return DLL_ERR_OK;
@@ -236,6 +307,43 @@ DLL_Error listInsertBefore(List* list, int index, listElem value)
 }
 
 
+// Only the links change: the element keeps its index, and so do the others.
+DLL_Error listMoveAfter(List* list, int index, int after)
+{
+    LOGF(logFile, "listMoveAfter(%d, %d) started.\n", index, after);
+    if (list == NULL)
+        DUMP_AND_RETURN_ERROR(DLL_ERR_NULL_LIST_PASSED);
+    if (index < 0)
+        DUMP_AND_RETURN_ERROR(DLL_ERR_INVALID_INDEX_PASSED);
+    VERIFY_DUMP_RETURN_ERROR(list);
+
+    if (list->prev[index] == DLL_PREV_POISON)
+        DUMP_AND_RETURN_ERROR(DLL_ERR_ELEMENT_DOESNT_EXIST);
+
+    if (after == index || list->prev[index] == after)
+        return DLL_ERR_OK;
+
+    list->next[list->prev[index]] = list->next[index];
+    list->prev[list->next[index]] = list->prev[index];
+
+    list->next[index] = list->next[after];
+    list->prev[index] = after;
+    list->prev[list->next[after]] = index;
+    list->next[after] = index;
+
+    list->listInfo.isLinear = false;
+
+    int indPrev = list->prev[index];
+    int indNext = list->next[index];
+
+    if ((indPrev != -1 && list->data[indPrev].hash > list->data[index].hash) ||
+        (indNext != -1 && list->data[indNext].hash < list->data[index].hash))
+        list->listInfo.isSorted = false;
+
+    return DLL_ERR_OK;
+}
+
+
 DLL_Error listPushFront(List* list, listElem value)
 {
     LOGF(logFile, "listPushFront() started.\n");
@@ -264,29 +372,33 @@ DLL_Error listPushBack(List* list, listElem value)
 
     unsigned int newCapacity = (unsigned int)((float) list->listInfo.capacity * multiplier);
 
-    listElem* tempData = (listElem*) realloc(list->data - 1, sizeof(listElem) * (newCapacity + 1));
+    size_t oldElems = list->listInfo.capacity + 1;
+    size_t newElems = newCapacity + 1;
+
+    // Every array is updated right away: the old block may be gone already.
+    listElem* tempData = (listElem*) listRealloc(list->allocator, list->data - 1,
+                                                 sizeof(listElem) * oldElems,
+                                                 sizeof(listElem) * newElems);
     if (tempData == NULL)
     {
         DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
     }
+    list->data = tempData + 1;
 
-    int* tempNext = (int*) realloc(list->next - 1, sizeof(int) * (newCapacity + 1));
-    if (tempData == NULL)
+    int* tempNext = (int*) listRealloc(list->allocator, list->next - 1,
+                                       sizeof(int) * oldElems, sizeof(int) * newElems);
+    if (tempNext == NULL)
     {
-        free(tempData);
         DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
     }
+    list->next = tempNext + 1;
 
-    int* tempPrev = (int*) realloc(list->prev - 1, sizeof(int) * (newCapacity + 1));
+    int* tempPrev = (int*) listRealloc(list->allocator, list->prev - 1,
+                                       sizeof(int) * oldElems, sizeof(int) * newElems);
     if (tempPrev == NULL)
     {
-        free(tempData);
-        free(tempNext);
         DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
     }
-
-    list->data = tempData + 1;
-    list->next = tempNext + 1;
     list->prev = tempPrev + 1;
 
     // Fill in arrays with info.
@@ -313,42 +425,145 @@ DLL_Error listLinearize(List* list)
     int*    newPrev = NULL;
     int*    newNext = NULL;
 
-    if (allocListMem(&newData, &newPrev, &newNext, list->listInfo.capacity) != DLL_ERR_OK)
+    if (allocListMem(list->allocator, &newData, &newPrev, &newNext,
+                     list->listInfo.capacity) != DLL_ERR_OK)
         DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
 
-    int oldIndex = list->next[-1];
-    size_t newIndex = 0;
-    while (list->next[oldIndex] != -1)
+    int size = 0;
+    for (int oldIndex = list->next[-1]; oldIndex != -1; oldIndex = list->next[oldIndex])
     {
-        newData[newIndex] = list->data[oldIndex];
-        newIndex++;
-        oldIndex = list->next[oldIndex];
+        newData[size] = list->data[oldIndex];
+        size++;
     }
 
-    for (size_t i = 0; i < newIndex + 1; i++)
+    for (int i = 0; i < size; i++)
     {
-        newNext[i] = (int) i + 1;
-        newPrev[i] = (int) i - 1;
+        newNext[i] = i + 1;
+        newPrev[i] = i - 1;
     }
-    for (size_t i = newIndex + 1; i < list->listInfo.capacity; i++)
+
+    // The free slots follow in order, the last one is always free.
+    for (int i = size; i < (int) list->listInfo.capacity; i++)
     {
-        newNext[i] = (int) i + 1;
+        newNext[i] = i + 1;
         newPrev[i] = DLL_PREV_POISON;
     }
 
-    free(list->data - 1);
-    free(list->next - 1);
-    free(list->prev - 1);
+    newNext[list->listInfo.capacity - 1] = -1;
+
+    if (size > 0)
+        newNext[size - 1] = -1;
+
+    freeListMem(list);
 
     list->data = newData;
     list->next = newNext;
     list->prev = newPrev;
 
-    list->next[-1] = 0;
-    list->prev[-1] = (int) newIndex;
+    list->next[-1] = (size > 0) ? 0 : -1;
+    list->prev[-1] = size - 1;
+    list->free = size;
+
+    list->listInfo.isLinear = true;
+
+    return DLL_ERR_OK;
+}
+
+
+// The first element of a linear list with a hash greater than hash.
+static int listUpperBound(const List* list, uint64_t hash)
+{
+    int low  = 0;
+    int high = list->listInfo.size;
+
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+
+        if (list->data[middle].hash <= hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+
+// Before the first element with a greater hash, so a sorted list stays
+// sorted. Hashes that come in increasing order are appended right away.
+// A linear list stays linear: the greater elements move up by one, so
+// their indices change.
+DLL_Error listInsertSorted(List* list, listElem value)
+{
+    if (list == NULL)
+        DUMP_AND_RETURN_ERROR(DLL_ERR_NULL_LIST_PASSED);
+
+    int tail = list->prev[-1];
+
+    if (tail == -1 || list->data[tail].hash <= value.hash)
+        return listInsertAfter(list, tail, value);
+
+    int size = list->listInfo.size;
+
+    // A linear list takes the free slot right after its tail.
+    if (list->listInfo.isLinear && list->listInfo.isSorted && list->free == size)
+    {
+        if (list->free >= (int) list->listInfo.capacity - 1 &&
+            listChangeCapacity(list, DLL_CAPACITY_MULTIPLIER))
+            DUMP_AND_RETURN_ERROR(DLL_ERR_MEMORY_ALLOCATION_FAILURE);
+
+        int pos = listUpperBound(list, value.hash);
+
+        memmove(&list->data[pos + 1], &list->data[pos], sizeof(listElem) * (size_t)(size - pos));
+        list->data[pos] = value;
+
+        list->free = list->next[size];
+
+        list->next[size - 1] = size;
+        list->next[size]     = -1;
+        list->prev[size]     = size - 1;
+        list->prev[-1]       = size;
 
-    list->next[newIndex] = -1;
-    list->next[list->listInfo.capacity - 1] = -1;
+        list->listInfo.size++;
+
+        return DLL_ERR_OK;
+    }
+
+    // The tail is greater, so the walk stops before it ends.
+    int index = list->next[-1];
+    while (list->data[index].hash <= value.hash)
+        index = list->next[index];
+
+    return listInsertAfter(list, list->prev[index], value);
+}
+
+
+static int listCompareHashes(const void* a, const void* b)
+{
+    uint64_t hashA = ((const listElem*) a)->hash;
+    uint64_t hashB = ((const listElem*) b)->hash;
+
+    return (hashA > hashB) - (hashA < hashB);
+}
+
+
+// Linear, the links don't change when the elements are sorted in place.
+DLL_Error listSortByHash(List* list)
+{
+    if (list == NULL)
+        DUMP_AND_RETURN_ERROR(DLL_ERR_NULL_LIST_PASSED);
+
+    if (!list->listInfo.isLinear)
+    {
+        DLL_Error err = listLinearize(list);
+        if (err != DLL_ERR_OK)
+            return err;
+    }
+
+    qsort(list->data, (size_t) list->listInfo.size, sizeof(listElem), listCompareHashes);
+
+    list->listInfo.isSorted = true;
 
     return DLL_ERR_OK;
 }
@@ -365,7 +580,7 @@ DLL_Error listLookUp(List* list, const char* str, size_t len, int* value)
     {
         LOGF(logFile, "checking index: %d\n", index);
         listElem curData = list->data[index];
-        if (strncmp(curData.str, str, len) == 0)
+        if (strncmp(curData.key, str, len) == 0)
         {
             *value = index;
             return DLL_ERR_OK;
@@ -377,6 +592,17 @@ DLL_Error listLookUp(List* list, const char* str, size_t len, int* value)
     return DLL_ERR_OK;
 }
 
+// ptest needs SSE4.1, the baseline build compares the bytes instead.
+static inline bool listKeysEqual(__m128i a, __m128i b)
+{
+#ifdef __SSE4_1__
+    __m128i cmp = _mm_xor_si128(a, b);
+    return _mm_test_all_zeros(cmp, cmp);
+#else
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF;
+#endif
+}
+
 DLL_Error listLookUp16(List* list, const char* str, size_t len, int* value)
 {
     LOGF(logFile, "listLookUp() started.\n");
@@ -396,12 +622,11 @@ DLL_Error listLookUp16(List* list, const char* str, size_t len, int* value)
     while (index != -1)
     {
         LOGF(logFile, "checking index: %d\n", index);
-        listElem curData = list->data[index];
+        const listElem* curData = &list->data[index];
 
-        __m128i _testStr16 = _mm_loadu_si128((const __m128i*)curData.str);
+        __m128i _testStr16 = _mm_load_si128((const __m128i*)curData->key);
 
-        __m128i cmp = _mm_xor_si128(_refStr16_register, _testStr16);
-        if (_mm_test_all_zeros(cmp, cmp)) {
+        if (listKeysEqual(_refStr16_register, _testStr16)) {
             *value = index;
             return DLL_ERR_OK;
         }
@@ -433,14 +658,17 @@ DLL_Error listLookUp16_hash(List* list, const char* str, uint64_t hash, size_t l
     while (index != -1)
     {
         LOGF(logFile, "checking index: %d\n", index);
-        listElem curData = list->data[index];
+        const listElem* curData = &list->data[index];
+
+        // Everything further is greater.
+        if (list->listInfo.isSorted && curData->hash > hash)
+            break;
 
-        if (hash == curData.hash) {
+        if (hash == curData->hash) {
 
-            __m128i _testStr16 = _mm_loadu_si128((const __m128i*)curData.str);
+            __m128i _testStr16 = _mm_load_si128((const __m128i*)curData->key);
 
-            __m128i cmp = _mm_xor_si128(_refStr16_register, _testStr16);
-            if (_mm_test_all_zeros(cmp, cmp)) {
+            if (listKeysEqual(_refStr16_register, _testStr16)) {
                 *value = index;
                 return DLL_ERR_OK;
             }
@@ -0,0 +1,665 @@
+#include "async_log.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+// A ring has one producer, its thread, and one consumer, whoever holds
+// logWriterLock. head and tail only grow, positions are taken modulo logRingSize.
+// A record that doesn't fit before the end of the ring is preceded by
+// a padding record up to the end, so every record is contiguous.
+//
+// Record: LogRecord, then for every argument LogRecordArg and 8 bytes
+// of value, or the string with its NUL, rounded up to 8 bytes.
+
+struct LogRecord
+{
+    uint32_t size;      // with the arguments, logPadFlag for a padding record
+    uint32_t nArgs;
+    uint64_t tsc;
+    const LogSite* site;
+    FILE* file;
+};
+
+struct LogRecordArg
+{
+    uint32_t type;
+    uint32_t size;      // of the value
+};
+
+struct alignas(64) LogRing
+{
+    uint64_t head;
+
+    alignas(64) uint64_t tail;
+    uint64_t drainHead;         // head when the drain started
+    uint64_t drainDropped;      // dropped then, all before drainHead
+    uint64_t reportedDropped;
+    FILE* lastFile;             // of the last record written
+
+    alignas(64) uint64_t dropped;
+    bool inUse;                 // a thread owns the ring
+    LogRing* next;
+
+    alignas(64) char data[logRingSize];
+};
+
+const uint32_t logPadFlag = 1u << 31;
+
+// Records are padded to it, and the pad record needs only its size.
+const size_t logRecordAlign = 8;
+
+const long logWriterSleepNs = 1000 * 1000;
+
+// A ring filled past it wakes the writer up before the sleep is over.
+const size_t logHighWater = logRingSize / 2;
+
+// The prefix is padded to it, as the synchronous LOGF_COLOR does.
+const int logPrefixSize = 50;
+
+static LogRing* logRings = NULL;
+
+static pthread_once_t  logWriterOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t logWriterLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t       logWriterThread;
+static bool            logWriterStarted = false;
+static bool            logWriterStop = false;
+
+// The writer sleeps on logWakeCond, a thread whose ring is filling up
+// wakes it. logWriterSleeping lets the others skip the lock.
+static pthread_mutex_t logWakeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  logWakeCond = PTHREAD_COND_INITIALIZER;
+static bool            logWriterSleeping = false;
+static bool            logWakeRequested = false;
+
+static bool            logBlocking = false;
+
+// Clock at the writer start, for the frequency of rdtsc.
+static uint64_t logStartTsc = 0;
+static struct timespec logStartTime = {};
+
+
+// Gives the ring back when its thread exits, the records left are still written.
+struct LogRingOwner
+{
+    LogRing* ring;
+
+    ~LogRingOwner()
+    {
+        if (ring)
+            __atomic_store_n(&ring->inUse, false, __ATOMIC_RELEASE);
+    }
+};
+
+static thread_local LogRingOwner logRingOwner = {};
+
+
+static size_t logAlign(size_t size)
+{
+    return (size + logRecordAlign - 1) & ~(logRecordAlign - 1);
+}
+
+
+// As printf prints it.
+static const char* logGetStr(const char* str)
+{
+    return (str == NULL) ? "(null)" : str;
+}
+
+
+static size_t logGetStrLen(const char* str)
+{
+    return strnlen(logGetStr(str), logMaxStrLen);
+}
+
+
+static size_t logGetRecordSize(const LogArg* args, size_t nArgs)
+{
+    size_t size = sizeof(LogRecord);
+
+    for (size_t i = 0; i < nArgs; i++)
+    {
+        size += sizeof(LogRecordArg);
+        size += (args[i].type == LOG_ARG_STR) ? logAlign(logGetStrLen(args[i].s) + 1) : 8;
+    }
+
+    return size;
+}
+
+
+static void logFormat(FILE* file, const char* format, const char* args, uint32_t nArgs);
+static size_t logDrain();
+static void logStopWriter();
+
+
+// Sleeps for logWriterSleepNs or until a ring passes logHighWater.
+static void logWriterSleep()
+{
+    struct timespec deadline = {};
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    deadline.tv_nsec += logWriterSleepNs;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+    }
+
+    pthread_mutex_lock(&logWakeLock);
+
+    __atomic_store_n(&logWriterSleeping, true, __ATOMIC_SEQ_CST);
+
+    if (!logWakeRequested && !__atomic_load_n(&logWriterStop, __ATOMIC_ACQUIRE))
+        pthread_cond_timedwait(&logWakeCond, &logWakeLock, &deadline);
+
+    __atomic_store_n(&logWriterSleeping, false, __ATOMIC_RELAXED);
+    logWakeRequested = false;
+
+    pthread_mutex_unlock(&logWakeLock);
+}
+
+
+static void logWakeWriter()
+{
+    if (!__atomic_exchange_n(&logWriterSleeping, false, __ATOMIC_SEQ_CST))
+        return;
+
+    pthread_mutex_lock(&logWakeLock);
+    logWakeRequested = true;
+    pthread_cond_signal(&logWakeCond);
+    pthread_mutex_unlock(&logWakeLock);
+}
+
+
+static void* logWriterLoop(void*)
+{
+    while (!__atomic_load_n(&logWriterStop, __ATOMIC_ACQUIRE))
+    {
+        if (logDrain() == 0)
+            logWriterSleep();
+    }
+
+    return NULL;
+}
+
+
+static void logStartWriter()
+{
+    logStartTsc = __rdtsc();
+    clock_gettime(CLOCK_REALTIME, &logStartTime);
+
+    if (pthread_create(&logWriterThread, NULL, logWriterLoop, NULL) == 0)
+        logWriterStarted = true;
+
+    atexit(logStopWriter);
+}
+
+
+// Without the writer thread the records are written by logFlush and at exit.
+static void logStopWriter()
+{
+    if (logWriterStarted)
+    {
+        __atomic_store_n(&logWriterStop, true, __ATOMIC_RELEASE);
+        logWakeWriter();
+        pthread_join(logWriterThread, NULL);
+        logWriterStarted = false;
+    }
+
+    logDrain();
+}
+
+
+// Takes a ring left by an exited thread, or makes a new one. A ring with
+// records still to be written isn't taken, there may be little space left.
+static LogRing* logGetRing()
+{
+    if (logRingOwner.ring)
+        return logRingOwner.ring;
+
+    pthread_once(&logWriterOnce, logStartWriter);
+
+    LogRing* ring = __atomic_load_n(&logRings, __ATOMIC_ACQUIRE);
+
+    for (; ring != NULL; ring = ring->next)
+    {
+        bool expected = false;
+        if (!__atomic_compare_exchange_n(&ring->inUse, &expected, true, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            continue;
+
+        if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) ==
+            __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+            break;
+
+        __atomic_store_n(&ring->inUse, false, __ATOMIC_RELEASE);
+    }
+
+    if (ring == NULL)
+    {
+        ring = (LogRing*) aligned_alloc(alignof(LogRing), sizeof(LogRing));
+        if (ring == NULL)
+            return NULL;
+
+        memset((void*) ring, 0, sizeof(LogRing));
+        ring->inUse = true;
+        ring->next = __atomic_load_n(&logRings, __ATOMIC_RELAXED);
+
+        while (!__atomic_compare_exchange_n(&logRings, &ring->next, ring, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+
+    logRingOwner.ring = ring;
+
+    return ring;
+}
+
+
+void logSetBlocking(bool blocking)
+{
+    __atomic_store_n(&logBlocking, blocking, __ATOMIC_RELAXED);
+}
+
+
+void logWriteArgs(FILE* file, const LogSite* site, const LogArg* args, size_t nArgs)
+{
+    if (file == NULL)
+        return;
+
+    uint64_t tsc = __rdtsc();
+
+    LogRing* ring = logGetRing();
+    if (ring == NULL)
+        return;
+
+    size_t size = logGetRecordSize(args, nArgs);
+
+    uint64_t head = ring->head;
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    size_t pos    = (size_t)(head % logRingSize);
+    size_t padding = (logRingSize - pos < size) ? logRingSize - pos : 0;
+
+    // Blocking, the thread writes the records out itself and takes the space.
+    if (head + padding + size - tail > logRingSize &&
+        __atomic_load_n(&logBlocking, __ATOMIC_RELAXED) && size <= logRingSize / 2)
+    {
+        logDrain();
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    }
+
+    if (head + padding + size - tail > logRingSize)
+    {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        logWakeWriter();
+        return;
+    }
+
+    if (padding)
+    {
+        uint32_t padSize = (uint32_t) padding | logPadFlag;
+        memcpy(ring->data + pos, &padSize, sizeof(padSize));
+
+        pos = 0;
+    }
+
+    char* out = ring->data + pos;
+
+    LogRecord record = {(uint32_t) size, (uint32_t) nArgs, tsc, site, file};
+    memcpy(out, &record, sizeof(record));
+    out += sizeof(record);
+
+    for (size_t i = 0; i < nArgs; i++)
+    {
+        LogRecordArg recordArg = {(uint32_t) args[i].type, 8};
+
+        if (args[i].type == LOG_ARG_STR)
+        {
+            size_t len = logGetStrLen(args[i].s);
+            recordArg.size = (uint32_t) logAlign(len + 1);
+
+            memcpy(out, &recordArg, sizeof(recordArg));
+            memcpy(out + sizeof(recordArg), logGetStr(args[i].s), len);
+            out[sizeof(recordArg) + len] = '\0';
+        }
+        else
+        {
+            memcpy(out, &recordArg, sizeof(recordArg));
+            memcpy(out + sizeof(recordArg), &args[i].u, 8);
+        }
+
+        out += sizeof(recordArg) + recordArg.size;
+    }
+
+    __atomic_store_n(&ring->head, head + padding + size, __ATOMIC_RELEASE);
+
+    if (head + padding + size - tail >= logHighWater)
+        logWakeWriter();
+}
+
+
+// The wall clock time of a record: its age in rdtsc ticks, converted with
+// the frequency measured since the writer started.
+static time_t logGetRecordTime(uint64_t tsc, uint64_t nowTsc, const struct timespec* now)
+{
+    double elapsedNs = (double)(now->tv_sec - logStartTime.tv_sec) * 1e9 +
+                       (double)(now->tv_nsec - logStartTime.tv_nsec);
+
+    double ticksPerNs = 1;
+    if (elapsedNs > 1e6)
+        ticksPerNs = (double)(nowTsc - logStartTsc) / elapsedNs;
+
+    double ageNs = (tsc < nowTsc) ? (double)(nowTsc - tsc) / ticksPerNs : 0;
+    double nowNs = (double) now->tv_sec * 1e9 + (double) now->tv_nsec;
+
+    return (time_t)((nowNs - ageNs) / 1e9);
+}
+
+
+// The same text as the synchronous LOGF_COLOR.
+static void logPrintRecord(const LogRecord* record, const char* args, time_t recordTime)
+{
+    const LogSite* site = record->site;
+    FILE* file = record->file;
+
+    // Under logWriterLock, records of the same second reuse the string.
+    static time_t lastTime = -1;
+    static char   timeStr[10] = {};
+
+    if (recordTime != lastTime)
+    {
+        struct tm timeInfo = {};
+        localtime_r(&recordTime, &timeInfo);
+
+        strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &timeInfo);
+        lastTime = recordTime;
+    }
+
+    char prefix[logPrefixSize] = {};
+    snprintf(prefix, sizeof(prefix), "[%s]{%s(%-3d)}: ", timeStr, site->fileName, site->line);
+
+    fprintf(file, "<font color=lightgreen>%-*s", logPrefixSize, prefix);
+    fprintf(file, "<font color=%s>", site->color);
+    logFormat(file, site->format, args, record->nArgs);
+    fprintf(file, "</font>");
+}
+
+
+// The next record of the ring before drainHead, skipping the padding.
+static const char* logPeekRecord(LogRing* ring, LogRecord* record)
+{
+    while (ring->tail < ring->drainHead)
+    {
+        const char* in = ring->data + ring->tail % logRingSize;
+
+        memcpy(&record->size, in, sizeof(record->size));
+
+        if (!(record->size & logPadFlag))
+        {
+            memcpy(record, in, sizeof(*record));
+            return in;
+        }
+
+        __atomic_store_n(&ring->tail, ring->tail + (record->size & ~logPadFlag), __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+
+// Writes the records of every ring and flushes the files they went to.
+// The rings are merged by rdtsc, so the threads' messages are in order.
+// Returns the number of records written.
+static size_t logDrain()
+{
+    const size_t maxFiles = 8;
+    FILE* files[maxFiles] = {};
+    size_t nFiles = 0;
+    size_t nRecords = 0;
+
+    pthread_mutex_lock(&logWriterLock);
+
+    uint64_t nowTsc = __rdtsc();
+    struct timespec now = {};
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    LogRing* rings = __atomic_load_n(&logRings, __ATOMIC_ACQUIRE);
+
+    for (LogRing* ring = rings; ring; ring = ring->next)
+    {
+        ring->drainDropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        ring->drainHead    = __atomic_load_n(&ring->head,    __ATOMIC_ACQUIRE);
+    }
+
+    while (true)
+    {
+        LogRing* first = NULL;
+        const char* in = NULL;
+        LogRecord record = {};
+
+        for (LogRing* ring = rings; ring; ring = ring->next)
+        {
+            LogRecord ringRecord = {};
+            const char* ringIn = logPeekRecord(ring, &ringRecord);
+
+            if (ringIn && (first == NULL || ringRecord.tsc < record.tsc))
+            {
+                first  = ring;
+                in     = ringIn;
+                record = ringRecord;
+            }
+        }
+
+        if (first == NULL)
+            break;
+
+        logPrintRecord(&record, in + sizeof(record), logGetRecordTime(record.tsc, nowTsc, &now));
+
+        bool isKnownFile = false;
+        for (size_t i = 0; i < nFiles; i++)
+            isKnownFile |= (files[i] == record.file);
+
+        if (!isKnownFile && nFiles < maxFiles)
+            files[nFiles++] = record.file;
+        else if (!isKnownFile)
+            fflush(record.file);
+
+        // The thread may reuse the space right away.
+        __atomic_store_n(&first->tail, first->tail + record.size, __ATOMIC_RELEASE);
+        first->lastFile = record.file;
+        nRecords++;
+    }
+
+    // A thread drops records when its ring is full, after the ones written.
+    for (LogRing* ring = rings; ring; ring = ring->next)
+    {
+        if (ring->drainDropped != ring->reportedDropped && ring->lastFile)
+        {
+            fprintf(ring->lastFile, "<font color=red>%" PRIu64 " log records dropped</font>\n",
+                    ring->drainDropped - ring->reportedDropped);
+            ring->reportedDropped = ring->drainDropped;
+        }
+    }
+
+    for (size_t i = 0; i < nFiles; i++)
+        fflush(files[i]);
+
+    pthread_mutex_unlock(&logWriterLock);
+
+    return nRecords;
+}
+
+
+void logFlush()
+{
+    logDrain();
+}
+
+
+int logCloseFile(FILE* file)
+{
+    if (file == NULL)
+        return 0;
+
+    logFlush();
+
+    return fclose(file);
+}
+
+
+static const LogRecordArg* logNextArg(const char** args, uint32_t* nArgs)
+{
+    if (*nArgs == 0)
+        return NULL;
+
+    const LogRecordArg* arg = (const LogRecordArg*) *args;
+
+    *args += sizeof(LogRecordArg) + arg->size;
+    (*nArgs)--;
+
+    return arg;
+}
+
+
+static int64_t logGetInt(const LogRecordArg* arg)
+{
+    int64_t value = 0;
+    memcpy(&value, arg + 1, sizeof(value));
+
+    return value;
+}
+
+
+// The formats are built from the literals of the call sites, which the
+// compiler has checked there, see LOGF_COLOR.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+// Prints one conversion, spec is the conversion without its length
+// modifier. The types of the values are the ones of the record.
+static void logPrintArg(FILE* file, char* spec, size_t specLen, char conversion,
+                        const LogRecordArg* arg)
+{
+    const char* value = (const char*)(arg + 1);
+
+    if (strchr("diouxXc", conversion) && (arg->type == LOG_ARG_INT || arg->type == LOG_ARG_UINT))
+    {
+        if (conversion != 'c')
+        {
+            spec[specLen++] = 'l';
+            spec[specLen++] = 'l';
+        }
+        spec[specLen++] = conversion;
+        spec[specLen] = '\0';
+
+        if (conversion == 'c')
+            fprintf(file, spec, (int) logGetInt(arg));
+        else
+            fprintf(file, spec, (long long) logGetInt(arg));
+    }
+    else if (strchr("eEfFgGaA", conversion) && arg->type == LOG_ARG_DOUBLE)
+    {
+        double number = 0;
+        memcpy(&number, value, sizeof(number));
+
+        spec[specLen++] = conversion;
+        spec[specLen] = '\0';
+
+        fprintf(file, spec, number);
+    }
+    else if (conversion == 's' && arg->type == LOG_ARG_STR)
+    {
+        spec[specLen++] = 's';
+        spec[specLen] = '\0';
+
+        fprintf(file, spec, value);
+    }
+    else if (conversion == 'p')
+    {
+        const void* pointer = NULL;
+        memcpy(&pointer, value, sizeof(pointer));
+
+        spec[specLen++] = 'p';
+        spec[specLen] = '\0';
+
+        fprintf(file, spec, pointer);
+    }
+    else
+    {
+        fprintf(file, "<?>");
+    }
+}
+
+#pragma GCC diagnostic pop
+
+
+// printf of the recorded arguments. Length modifiers are dropped: integers
+// are recorded as 64-bit and floats as double anyway.
+static void logFormat(FILE* file, const char* format, const char* args, uint32_t nArgs)
+{
+    const size_t maxSpecLen = 64;
+
+    while (*format)
+    {
+        const char* percent = strchr(format, '%');
+        if (percent == NULL)
+        {
+            fputs(format, file);
+            return;
+        }
+
+        fwrite(format, 1, (size_t)(percent - format), file);
+        format = percent + 1;
+
+        if (*format == '%')
+        {
+            fputc('%', file);
+            format++;
+            continue;
+        }
+
+        char spec[maxSpecLen] = "%";
+        size_t specLen = 1;
+
+        // Flags, width and precision, '*' takes an argument.
+        for (; *format && strchr("-+ #0123456789.*", *format); format++)
+        {
+            if (specLen >= maxSpecLen - 24)
+                continue;
+
+            if (*format != '*')
+            {
+                spec[specLen++] = *format;
+                continue;
+            }
+
+            const LogRecordArg* arg = logNextArg(&args, &nArgs);
+            int written = snprintf(spec + specLen, maxSpecLen - specLen, "%d",
+                                   arg ? (int) logGetInt(arg) : 0);
+            specLen += (size_t) written;
+        }
+
+        while (*format && strchr("hlLqjzt", *format))
+            format++;
+
+        if (*format == '\0')
+            return;
+
+        char conversion = *format++;
+
+        const LogRecordArg* arg = logNextArg(&args, &nArgs);
+        if (conversion == 'n')
+            continue;
+
+        if (arg == NULL)
+        {
+            fprintf(file, "<?>");
+            continue;
+        }
+
+        logPrintArg(file, spec, specLen, conversion, arg);
+    }
+}
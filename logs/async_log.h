@@ -0,0 +1,110 @@
+#ifndef ASYNC_LOG_H_
+#define ASYNC_LOG_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <type_traits>
+
+// Backend of LOGF_COLOR. A message is not formatted where it's logged:
+// the thread copies a binary record (rdtsc, the call site, the arguments)
+// into a ring buffer of its own, and a background thread formats the
+// records of all the rings into the usual HTML. Nothing is locked on the
+// way in. A ring filled past half wakes the writer up. If the threads log
+// faster than the writer formats, a full ring drops the record and the
+// writer reports how many were lost; see logSetBlocking.
+//
+// The format string is parsed by the writer, so it must be a literal.
+// Strings (%s) are copied, up to logMaxStrLen bytes.
+
+// Bytes of the ring of every thread.
+const size_t logRingSize  = 256 * 1024;
+const size_t logMaxStrLen = 255;
+
+// Everything known about a call at compile time, the format id of a record.
+struct LogSite
+{
+    const char* format;
+    const char* fileName;
+    int line;
+    const char* color;
+};
+
+enum LogArgType
+{
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR,
+    LOG_ARG_PTR,
+};
+
+struct LogArg
+{
+    LogArgType type;
+    union
+    {
+        int64_t     i;
+        uint64_t    u;
+        double      d;
+        const char* s;
+        const void* p;
+    };
+};
+
+template <typename T>
+LogArg logMakeArg(T value)
+{
+    LogArg arg = {};
+
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        arg.type = LOG_ARG_DOUBLE;
+        arg.d = (double) value;
+    }
+    else if constexpr (std::is_enum<T>::value || std::is_signed<T>::value)
+    {
+        arg.type = LOG_ARG_INT;
+        arg.i = (int64_t) value;
+    }
+    else if constexpr (std::is_integral<T>::value)
+    {
+        arg.type = LOG_ARG_UINT;
+        arg.u = (uint64_t) value;
+    }
+    else if constexpr (std::is_convertible<T, const char*>::value)
+    {
+        arg.type = LOG_ARG_STR;
+        arg.s = value;
+    }
+    else
+    {
+        arg.type = LOG_ARG_PTR;
+        arg.p = (const void*) value;
+    }
+
+    return arg;
+}
+
+void logWriteArgs(FILE* file, const LogSite* site, const LogArg* args, size_t nArgs);
+
+template <typename... Args>
+void logWrite(FILE* file, const LogSite* site, Args... args)
+{
+    const LogArg logArgs[sizeof...(Args) + 1] = {logMakeArg(args)...};
+
+    logWriteArgs(file, site, logArgs, sizeof...(Args));
+}
+
+// With blocking on, a thread whose ring is full writes the records out
+// itself instead of dropping them, so nothing is lost but the logging
+// threads run at the speed of the writer. Off by default.
+void logSetBlocking(bool blocking);
+
+// Writes out every record logged so far. The writer thread does it about
+// every millisecond anyway; needed before writing to a log file directly.
+void logFlush();
+
+// logFlush, then fclose. Records logged to the file later are lost.
+int  logCloseFile(FILE* file);
+
+#endif // ASYNC_LOG_H_
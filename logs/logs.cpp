@@ -21,7 +21,9 @@ FILE* logOpenFile(const char* fileName)
     if (!logFile)
         return NULL;
 
+#ifdef LOG_SYNC
     setvbuf(logFile, NULL, _IONBF, 0);
+#endif
 
     fprintf(logFile, "<pre style=\"background: #000000;color:#000000;\">");
 
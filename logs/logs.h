@@ -4,11 +4,16 @@
 #include <stdio.h> 
 #include <stdlib.h>
 
+#include "async_log.h"
+
 void getCurrentTimeStr(char* str, size_t bufferSize);
 
 FILE* logOpenFile(const char* fileName);
 
-#ifndef NLOG
+// LOGF_COLOR hands the message to the writer thread, see async_log.h.
+// LOG_SYNC formats and writes it right away instead, like the other macros
+// do: slow, but nothing is lost if the program crashes.
+#if !defined(NLOG) && defined(LOG_SYNC)
     #define LOG_START_COLOR(file, color)                                         \
     do                                                                           \
     {                                                                            \
@@ -60,6 +65,54 @@ FILE* logOpenFile(const char* fileName);
     #define LOGF_ERR(file, ...) LOGF_COLOR(file, red,    "ERROR! "   __VA_ARGS__)
     #define LOGF_WRN(file, ...) LOGF_COLOR(file, orange, "WARNING! " __VA_ARGS__)
 
+    #define LOG_FUNC_START(file) LOGF_COLOR(file, purple, "%s started\n", __PRETTY_FUNCTION__)
+    #define LOG_FUNC_END(file)   LOGF_COLOR(file, purple, "%s ended\n",   __PRETTY_FUNCTION__)
+#elif !defined(NLOG)
+    // Written right away, after the messages still in the rings.
+    #define LOG_START_COLOR(file, color)                                         \
+    do                                                                           \
+    {                                                                            \
+        if (file != NULL)                                                        \
+        {                                                                        \
+            logFlush();                                                          \
+            fprintf(file, "<font color=" #color ">");                            \
+        }                                                                        \
+    } while (0)
+
+    #define LOG_COLOR(file, color, ...)                                          \
+    do                                                                           \
+    {                                                                            \
+        if (file != NULL)                                                        \
+        {                                                                        \
+            LOG_START_COLOR(file, color);                                        \
+            fprintf(file, __VA_ARGS__);                                          \
+        }                                                                        \
+    } while (0)
+
+    #define LOG_END(file)                                                        \
+    do                                                                           \
+    {                                                                            \
+        if (file != NULL)                                                        \
+        {                                                                        \
+            fprintf(file, "</font>");                                            \
+        }                                                                        \
+    } while (0)
+
+    // The unevaluated fprintf lets the compiler check the format.
+    #define LOGF_COLOR_ASYNC(file, color, format, ...)                           \
+    do                                                                           \
+    {                                                                            \
+        static const LogSite site_log = {format, __FILE__, __LINE__, #color};    \
+        (void) sizeof(fprintf(file, format, ##__VA_ARGS__));                     \
+        logWrite(file, &site_log, ##__VA_ARGS__);                                \
+    } while (0)
+
+    #define LOGF_COLOR(file, color, ...) LOGF_COLOR_ASYNC(file, color, __VA_ARGS__)
+
+    #define LOGF(file, ...)     LOGF_COLOR(file, white,  "\t"        __VA_ARGS__)
+    #define LOGF_ERR(file, ...) LOGF_COLOR(file, red,    "ERROR! "   __VA_ARGS__)
+    #define LOGF_WRN(file, ...) LOGF_COLOR(file, orange, "WARNING! " __VA_ARGS__)
+
     #define LOG_FUNC_START(file) LOGF_COLOR(file, purple, "%s started\n", __PRETTY_FUNCTION__)
     #define LOG_FUNC_END(file)   LOGF_COLOR(file, purple, "%s ended\n",   __PRETTY_FUNCTION__)
 #else
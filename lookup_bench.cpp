@@ -0,0 +1,568 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./bench_words.h"
+
+// Single-threaded benchmark of the C API: insert, hit lookup, miss lookup
+// and remove, each measured on its own, for every function of gHashFunctions
+// and a grid of bucket counts and max load factors. hit_batch is the hit
+// lookup through ht_LookUpBatch, gSampleOps words per call. hit_zipf looks
+// up the distinct words as often as the words of a text: the word of rank r
+// with the weight 1 / r^gZipfExponent, the ranks shuffled, so the hot words
+// are anywhere in their buckets. It runs on a table of its own, where
+// every distinct word was inserted once, so a reorder mode has learned
+// nothing of the text before. -o sets ht_SetReorder for every table.
+//
+// Usage: lookup_bench [-d dict] [-r runs] [-o none|mtf|transpose]
+//                     [-c results.csv] [-j results.json]
+//
+// An operation is shorter than the clock resolution, so the clock is read
+// every gSampleOps operations: a sample is the mean of those. Percentiles
+// are taken over the samples of all the runs, the first run of every
+// configuration is a warm-up and isn't counted.
+
+const char gDictName[] = "dict.txt";
+
+const size_t gNumBuckets[]     = {997, 10007, 100003};
+const float  gMaxLoadFactors[] = {0.0f, 1.0f, 4.0f};
+
+const int    gDefaultRuns = 5;
+const size_t gSampleOps   = 32;
+
+const double   gZipfExponent = 1.0;
+const uint64_t gZipfSeed     = 0x5EED;
+
+enum Op
+{
+    OP_INSERT,
+    OP_HIT,
+    OP_HIT_BATCH,
+    OP_HIT_ZIPF,
+    OP_MISS,
+    OP_REMOVE,
+    N_OPS,
+};
+
+const char* const gOpNames[N_OPS] = {"insert", "hit", "hit_batch", "hit_zipf", "miss",
+                                     "remove"};
+
+// In the order of ht_Reorder.
+const char* const gReorderNames[] = {"none", "mtf", "transpose"};
+
+struct Samples {
+    double* ns;         // per op, one value per sample
+    size_t  n_samples;
+    double* run_ns;     // per op, one value per run
+    int     n_runs;
+};
+
+struct Result {
+    const char* hash_name;
+    ht_Reorder reorder;
+    size_t n_buckets;
+    float  max_load_factor;
+    double load_factor; // after all the inserts
+    Op     op;
+    size_t ops_per_run;
+    double ns_per_op;
+    double stddev_ns;   // of ns_per_op between the runs
+    double p50;
+    double p99;
+    double p999;
+};
+
+
+static uint64_t GetTimeNs() {
+    timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+
+// Looks up words [first, last) of the set with one ht_LookUpBatch.
+// Returns the number of words not found.
+static size_t RunBatch(ht_HashTable* ht, const WordSet* set, size_t first, size_t last) {
+    const char* strs  [gSampleOps] = {};
+    size_t      lens  [gSampleOps] = {};
+    size_t      values[gSampleOps] = {};
+
+    size_t count = last - first;
+
+    for (size_t i = 0; i < count; i++) {
+        strs[i] = set->words + (first + i) * ht_gMaxWordLen;
+        lens[i] = strnlen(strs[i], ht_gMaxWordLen);
+    }
+
+    if (ht_LookUpBatch(ht, strs, lens, count, values)) {
+        return count;
+    }
+
+    size_t n_missing = 0;
+    for (size_t i = 0; i < count; i++) {
+        n_missing += (values[i] == 0);
+    }
+
+    return n_missing;
+}
+
+
+// Runs op on every word of the set, a sample per gSampleOps words.
+// Returns the number of failed operations (other than NO_SUCH_ELEMENT for lookups).
+static size_t RunOp(ht_HashTable* ht, Op op, const WordSet* set, Samples* samples) {
+    size_t n_failed = 0;
+    size_t n_words = set->size / ht_gMaxWordLen;
+
+    uint64_t run_start = GetTimeNs();
+
+    for (size_t first = 0; first < n_words; first += gSampleOps) {
+        size_t last = (first + gSampleOps < n_words) ? first + gSampleOps : n_words;
+
+        uint64_t start = GetTimeNs();
+
+        if (op == OP_HIT_BATCH) {
+            n_failed += RunBatch(ht, set, first, last);
+        }
+
+        for (size_t i = first; i < last && op != OP_HIT_BATCH; i++) {
+            const char* word = set->words + i * ht_gMaxWordLen;
+            size_t len = strnlen(word, ht_gMaxWordLen);
+            size_t value = 0;
+
+            ht_Error err = HT_ERR_NO;
+
+            switch (op) {
+                case OP_INSERT:   err = ht_Insert(ht, word, len);         break;
+                case OP_HIT:
+                case OP_HIT_ZIPF: err = ht_LookUp(ht, word, len, &value); break;
+                case OP_MISS:     err = ht_LookUp(ht, word, len, &value);
+                                  err = (err == HT_ERR_NO_SUCH_ELEMENT) ? HT_ERR_NO : err;
+                                  break;
+                case OP_REMOVE:   err = ht_Remove(ht, word, len);         break;
+                case OP_HIT_BATCH:
+                case N_OPS:
+                default:          break;
+            }
+
+            n_failed += (err != HT_ERR_NO);
+        }
+
+        if (samples) {
+            samples->ns[samples->n_samples++] = (double)(GetTimeNs() - start) /
+                                                (double)(last - first);
+        }
+    }
+
+    if (samples && n_words) {
+        samples->run_ns[samples->n_runs++] = (double)(GetTimeNs() - run_start) /
+                                             (double) n_words;
+    }
+
+    return n_failed;
+}
+
+
+// hit_zipf on a fresh table holding the distinct words, see the top.
+static size_t RunZipf(const HashFunction* hash_function, size_t n_buckets, float max_load_factor,
+                      ht_Reorder reorder, const WordSet* distinct, const WordSet* zipf,
+                      Samples* samples) {
+    ht_HashTable ht = {};
+    if (ht_Contructor(&ht, n_buckets, hash_function->hash_func)) {
+        return 1;
+    }
+
+    ht_SetMaxLoadFactor(&ht, max_load_factor);
+    ht_SetReorder(&ht, reorder);
+
+    size_t n_failed = RunOp(&ht, OP_INSERT, distinct, nullptr);
+    n_failed += RunOp(&ht, OP_HIT_ZIPF, zipf, samples);
+
+    ht_Destructor(&ht);
+
+    return n_failed;
+}
+
+
+// One run: a fresh table, then every operation in turn.
+static int RunOnce(const HashFunction* hash_function, size_t n_buckets, float max_load_factor,
+                   ht_Reorder reorder, const WordSet sets[N_OPS], const WordSet* distinct,
+                   Samples* samples, double* load_factor) {
+    ht_HashTable ht = {};
+    if (ht_Contructor(&ht, n_buckets, hash_function->hash_func)) {
+        return -1;
+    }
+
+    ht_SetMaxLoadFactor(&ht, max_load_factor);
+    ht_SetReorder(&ht, reorder);
+
+    size_t n_failed = 0;
+    for (int op = 0; op < N_OPS; op++) {
+        Samples* op_samples = samples ? &samples[op] : nullptr;
+
+        if (op == OP_HIT_ZIPF) {
+            n_failed += RunZipf(hash_function, n_buckets, max_load_factor, reorder,
+                                distinct, &sets[op], op_samples);
+            continue;
+        }
+
+        n_failed += RunOp(&ht, (Op) op, &sets[op], op_samples);
+
+        if (op == OP_INSERT) {
+            *load_factor = (double) ht.n_elems / (double) ht.n_buckets;
+        }
+    }
+
+    ht_Destructor(&ht);
+
+    return n_failed ? -1 : 0;
+}
+
+
+static int CompareDoubles(const void* a, const void* b) {
+    double da = *(const double*) a;
+    double db = *(const double*) b;
+
+    return (da > db) - (da < db);
+}
+
+
+static double GetPercentile(const double* sorted, size_t n, double percentile) {
+    if (n == 0) {
+        return 0;
+    }
+
+    return sorted[(size_t)(percentile * (double)(n - 1) + 0.5)];
+}
+
+
+static void Summarize(Samples* samples, Result* result) {
+    double mean = 0;
+    for (int i = 0; i < samples->n_runs; i++) {
+        mean += samples->run_ns[i];
+    }
+    mean /= samples->n_runs ? samples->n_runs : 1;
+
+    double variance = 0;
+    for (int i = 0; i < samples->n_runs; i++) {
+        variance += (samples->run_ns[i] - mean) * (samples->run_ns[i] - mean);
+    }
+    variance /= samples->n_runs ? samples->n_runs : 1;
+
+    qsort(samples->ns, samples->n_samples, sizeof(double), CompareDoubles);
+
+    result->ns_per_op = mean;
+    result->stddev_ns = sqrt(variance);
+    result->p50  = GetPercentile(samples->ns, samples->n_samples, 0.5);
+    result->p99  = GetPercentile(samples->ns, samples->n_samples, 0.99);
+    result->p999 = GetPercentile(samples->ns, samples->n_samples, 0.999);
+}
+
+
+// Dictionary words have no '#', so a word with one is never in the table.
+static int GetMissingWords(const WordSet* distinct, WordSet* missing) {
+    missing->words = (char*) malloc(distinct->size + 1);
+    if (missing->words == nullptr) {
+        return -1;
+    }
+
+    memcpy(missing->words, distinct->words, distinct->size);
+    missing->size = distinct->size;
+
+    for (size_t pos = 0; pos < missing->size; pos += ht_gMaxWordLen) {
+        missing->words[pos] = '#';
+    }
+
+    return 0;
+}
+
+
+static uint64_t NextRandom(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+    return z ^ (z >> 31);
+}
+
+
+// n_words draws from the distinct words, Zipf-distributed. Always the same
+// ones, so the runs can be compared.
+static int GetZipfWords(const WordSet* distinct, size_t n_words, WordSet* zipf) {
+    size_t n_distinct = distinct->size / ht_gMaxWordLen;
+
+    size_t* ranks   = (size_t*) calloc(n_distinct + 1, sizeof(size_t));
+    double* weights = (double*) calloc(n_distinct + 1, sizeof(double));
+    zipf->words = (char*) calloc(n_words + 1, ht_gMaxWordLen);
+
+    if (ranks == nullptr || weights == nullptr || zipf->words == nullptr || n_distinct == 0) {
+        free(ranks);
+        free(weights);
+        return -1;
+    }
+
+    uint64_t state = gZipfSeed;
+
+    for (size_t i = 0; i < n_distinct; i++) {
+        size_t j = (size_t)(NextRandom(&state) % (i + 1));
+
+        ranks[i] = ranks[j];
+        ranks[j] = i;
+    }
+
+    double total = 0;
+    for (size_t rank = 0; rank < n_distinct; rank++) {
+        total += 1.0 / pow((double)(rank + 1), gZipfExponent);
+        weights[rank] = total;
+    }
+
+    for (size_t i = 0; i < n_words; i++) {
+        double target = (double)(NextRandom(&state) >> 11) / (double)(1ull << 53) * total;
+
+        size_t low  = 0;
+        size_t high = n_distinct - 1;
+
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+
+            if (weights[middle] < target) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+
+        memcpy(zipf->words + i * ht_gMaxWordLen,
+               distinct->words + ranks[low] * ht_gMaxWordLen, ht_gMaxWordLen);
+    }
+
+    zipf->size = n_words * ht_gMaxWordLen;
+
+    free(ranks);
+    free(weights);
+
+    return 0;
+}
+
+
+static void PrintCsv(FILE* file, const Result* results, size_t n_results) {
+    fprintf(file, "hash,reorder,n_buckets,max_load_factor,load_factor,op,ops_per_run,"
+                  "ns_per_op,stddev_ns,p50_ns,p99_ns,p999_ns\n");
+
+    for (size_t i = 0; i < n_results; i++) {
+        const Result* r = &results[i];
+
+        fprintf(file, "\"%s\",%s,%zu,%.2f,%.3f,%s,%zu,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+                r->hash_name, gReorderNames[r->reorder], r->n_buckets,
+                (double) r->max_load_factor, r->load_factor, gOpNames[r->op], r->ops_per_run,
+                r->ns_per_op, r->stddev_ns, r->p50, r->p99, r->p999);
+    }
+}
+
+
+static void PrintJson(FILE* file, const Result* results, size_t n_results) {
+    fprintf(file, "[\n");
+
+    for (size_t i = 0; i < n_results; i++) {
+        const Result* r = &results[i];
+
+        fprintf(file, "  {\"hash\": \"%s\", \"reorder\": \"%s\", \"n_buckets\": %zu, "
+                      "\"max_load_factor\": %.2f, \"load_factor\": %.3f, \"op\": \"%s\", "
+                      "\"ops_per_run\": %zu, "
+                      "\"ns_per_op\": %.2f, \"stddev_ns\": %.2f, "
+                      "\"p50_ns\": %.2f, \"p99_ns\": %.2f, \"p999_ns\": %.2f}%s\n",
+                r->hash_name, gReorderNames[r->reorder], r->n_buckets,
+                (double) r->max_load_factor, r->load_factor,
+                gOpNames[r->op], r->ops_per_run, r->ns_per_op, r->stddev_ns,
+                r->p50, r->p99, r->p999, (i + 1 < n_results) ? "," : "");
+    }
+
+    fprintf(file, "]\n");
+}
+
+
+static int WriteResults(const char* file_name, const Result* results, size_t n_results,
+                        void (*print)(FILE* file, const Result* results, size_t n_results)) {
+    FILE* file = fopen(file_name, "w");
+    if (file == nullptr) {
+        return -1;
+    }
+
+    print(file, results, n_results);
+
+    return fclose(file) ? -1 : 0;
+}
+
+
+static int RunBenchmarks(const WordSet sets[N_OPS], const WordSet* distinct, int n_runs,
+                         ht_Reorder reorder, Result* results, size_t* n_results) {
+    Samples samples[N_OPS] = {};
+
+    for (int op = 0; op < N_OPS; op++) {
+        size_t n_samples = (sets[op].size / ht_gMaxWordLen + gSampleOps - 1) / gSampleOps;
+
+        samples[op].ns     = (double*) calloc(n_samples * (size_t) n_runs + 1, sizeof(double));
+        samples[op].run_ns = (double*) calloc((size_t) n_runs, sizeof(double));
+
+        if (samples[op].ns == nullptr || samples[op].run_ns == nullptr) {
+            for (int i = 0; i <= op; i++) {
+                free(samples[i].ns);
+                free(samples[i].run_ns);
+            }
+
+            return -1;
+        }
+    }
+
+    int ret_value = 0;
+    const size_t n_hashes = sizeof(gHashFunctions) / sizeof(gHashFunctions[0]);
+
+    for (size_t hash = 0; hash < n_hashes && !ret_value; hash++) {
+        for (size_t n_buckets : gNumBuckets) {
+            for (float max_load_factor : gMaxLoadFactors) {
+                const HashFunction* hash_function = &gHashFunctions[hash];
+                double load_factor = 0;
+
+                for (int op = 0; op < N_OPS; op++) {
+                    samples[op].n_samples = 0;
+                    samples[op].n_runs = 0;
+                }
+
+                // Warm-up: caches, branch predictors, the page faults of the arena.
+                ret_value = RunOnce(hash_function, n_buckets, max_load_factor, reorder, sets,
+                                    distinct, nullptr, &load_factor);
+
+                for (int run = 0; run < n_runs && !ret_value; run++) {
+                    ret_value = RunOnce(hash_function, n_buckets, max_load_factor, reorder,
+                                        sets, distinct, samples, &load_factor);
+                }
+
+                if (ret_value) {
+                    fprintf(stderr, "%s failed\n", hash_function->description);
+                    break;
+                }
+
+                for (int op = 0; op < N_OPS; op++) {
+                    Result* result = &results[(*n_results)++];
+
+                    *result = {
+                        .hash_name       = hash_function->description,
+                        .reorder         = reorder,
+                        .n_buckets       = n_buckets,
+                        .max_load_factor = max_load_factor,
+                        .load_factor     = load_factor,
+                        .op              = (Op) op,
+                        .ops_per_run     = sets[op].size / ht_gMaxWordLen,
+                    };
+
+                    Summarize(&samples[op], result);
+                }
+
+                fprintf(stderr, "%-26s %6zu buckets, max load %.1f: hit %.1f ns, "
+                                "batch %.1f ns, zipf %.1f ns, miss %.1f ns\n",
+                        hash_function->description, n_buckets, (double) max_load_factor,
+                        results[*n_results - N_OPS + OP_HIT].ns_per_op,
+                        results[*n_results - N_OPS + OP_HIT_BATCH].ns_per_op,
+                        results[*n_results - N_OPS + OP_HIT_ZIPF].ns_per_op,
+                        results[*n_results - N_OPS + OP_MISS].ns_per_op);
+            }
+        }
+    }
+
+    for (int op = 0; op < N_OPS; op++) {
+        free(samples[op].ns);
+        free(samples[op].run_ns);
+    }
+
+    return ret_value;
+}
+
+
+int main(int argc, char** argv) {
+    const char* dict_name = gDictName;
+    const char* csv_name  = nullptr;
+    const char* json_name = nullptr;
+    const char* reorder_name = gReorderNames[HT_REORDER_NONE];
+    int n_runs = gDefaultRuns;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "d:r:o:c:j:")) != -1; ) {
+        switch (opt) {
+            case 'd': dict_name    = optarg;       break;
+            case 'r': n_runs       = atoi(optarg); break;
+            case 'o': reorder_name = optarg;       break;
+            case 'c': csv_name     = optarg;       break;
+            case 'j': json_name    = optarg;       break;
+            default:
+                fprintf(stderr, "Usage: %s [-d dict] [-r runs] [-o none|mtf|transpose] "
+                                "[-c results.csv] [-j results.json]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    int reorder = 0;
+    const int n_reorders = (int)(sizeof(gReorderNames) / sizeof(gReorderNames[0]));
+
+    while (reorder < n_reorders && strcmp(reorder_name, gReorderNames[reorder]) != 0) {
+        reorder++;
+    }
+
+    if (reorder == n_reorders) {
+        fprintf(stderr, "Unknown reorder %s\n", reorder_name);
+        return -1;
+    }
+
+    if (n_runs < 1) {
+        n_runs = 1;
+    }
+
+    WordSet dict = {};
+    ReadWords(dict_name, &dict);
+
+    if (dict.words == nullptr) {
+        return -1;
+    }
+
+    WordSet distinct = {};
+    WordSet missing  = {};
+    WordSet zipf     = {};
+
+    const size_t n_configs = sizeof(gHashFunctions) / sizeof(gHashFunctions[0]) *
+                             (sizeof(gNumBuckets) / sizeof(gNumBuckets[0])) *
+                             (sizeof(gMaxLoadFactors) / sizeof(gMaxLoadFactors[0]));
+
+    Result* results = (Result*) calloc(n_configs * N_OPS, sizeof(Result));
+    size_t n_results = 0;
+
+    int ret_value = -1;
+
+    if (dict.words && results && !GetDistinctWords(&dict, &distinct) &&
+        !GetMissingWords(&distinct, &missing) &&
+        !GetZipfWords(&distinct, dict.size / ht_gMaxWordLen, &zipf)) {
+        // Removes take every distinct word once, so each of them hits.
+        const WordSet sets[N_OPS] = {dict, dict, dict, zipf, missing, distinct};
+
+        ret_value = RunBenchmarks(sets, &distinct, n_runs, (ht_Reorder) reorder,
+                                  results, &n_results);
+    }
+
+    if (ret_value == 0) {
+        PrintCsv(stdout, results, n_results);
+
+        if ((csv_name  && WriteResults(csv_name,  results, n_results, PrintCsv)) ||
+            (json_name && WriteResults(json_name, results, n_results, PrintJson))) {
+            ret_value = -1;
+        }
+    }
+
+    free(results);
+    free(zipf.words);
+    free(missing.words);
+    free(distinct.words);
+    free(dict.words);
+
+    return ret_value;
+}
@@ -1,7 +1,7 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
-#include <immintrin.h>
+#include <unistd.h>
 
 #include "./hash_table/hash_table.h"
 #include "./logs/logs.h"
@@ -11,30 +11,37 @@
 
 const char gLogFileName[]    = "./build/log_file.html";
 const char gDictName[]       = "dict.txt";
+const float gMaxLoadFactor   = 2.0f;
+const bool gParallelInsert   = true;
+const bool gRawText          = false; // the dictionary is plain text, not NUL-separated words
+const bool gFreeze           = false; // look up in a minimal perfect hash of the dictionary
 
-int InsertDictionary (ht_HashTable* ht, const char* c_dict, size_t size);
-int TestLookUp       (ht_HashTable* ht, const char* file_name);
+int InsertDictionary      (ht_HashTable* ht, const char* c_dict, size_t size);
+int InsertDictionaryStream(ht_HashTable* ht, FILE* file);
+int LoadImage             (ht_HashTable* ht, const char* image_name);
+int SaveImage             (ht_HashTable* ht, const char* image_name);
+int TestLookUp            (ht_HashTable* ht, const char* file_name);
 
-int main() {
+// The dictionary is dict.txt or the file given, "-" is stdin.
+// The second argument is an image: it's loaded if it exists,
+// otherwise the table is built from the dictionary and saved there.
+int main(int argc, char** argv) {
     FILE* log_file = nullptr;
     int ret_value = 0;
     size_t dict_size = 0;
-    char* c_dict = nullptr;
+    const char* c_dict = nullptr;
     ht_HashTable ht = {};
     ht_Error err = HT_ERR_NO;
 
-    FILE* file = fopen(gDictName, "r");
+    const char* dict_name  = (argc > 1) ? argv[1] : gDictName;
+    const char* image_name = (argc > 2) ? argv[2] : nullptr;
+
+    FILE* file = (strcmp(dict_name, "-") == 0) ? stdin : fopen(dict_name, "r");
     if (file == nullptr) {
         ret_value = -1;
         goto fail_file;
     }
 
-    c_dict = (char*) ftbTransferBufferTo16(&dict_size, file);
-    if (c_dict == nullptr) {
-        ret_value = -1;
-        goto fail_dict;
-    }
-
     log_file = logOpenFile(gLogFileName);
     if (log_file == nullptr) {
         ret_value = -1;
@@ -43,18 +50,52 @@ int main() {
 
     ht_SetLogFile(log_file);
 
+    // Nothing to build then, the image is mapped and ready.
+    if (image_name && LoadImage(&ht, image_name) == 0) {
+        goto test;
+    }
+
+    // Words are read from the mapping in place, no padded copy.
+    // Pipes can't be mapped, they're streamed in chunks instead.
+    c_dict = ftbMapFile(&dict_size, file, FTB_MAP_POPULATE);
+
     err = ht_Contructor(&ht, 100000, HashCRC32_inline);
     if (err) {
         ret_value = -1;
         goto fail_constructor;
     }
 
-    if (InsertDictionary(&ht, c_dict, dict_size)) {
+    ht_SetMaxLoadFactor(&ht, gMaxLoadFactor);
+
+    if (c_dict ? InsertDictionary(&ht, c_dict, dict_size) : InsertDictionaryStream(&ht, file)) {
+        ret_value = -1;
+        goto fail_insert;
+    }
+
+    // Keys are copied into the table.
+    if (c_dict) {
+        ftbUnmapFile(c_dict, dict_size);
+        c_dict = nullptr;
+    }
+
+    if (image_name && SaveImage(&ht, image_name)) {
         ret_value = -1;
         goto fail_insert;
     }
 
-    if (TestLookUp(&ht, "dict.txt"))
+test:
+    if (gFreeze) {
+        if (ht_Freeze(&ht)) {
+            ret_value = -1;
+            goto fail_insert;
+        }
+
+        fprintf(stderr, "Frozen: %lg bits per key\n", ht_GetBitsPerKey(&ht));
+    }
+
+    // Raw text is split into other words, they can't be looked up as is.
+    // Stdin is gone by now, it can't be read a second time.
+    if (!gRawText && file != stdin && TestLookUp(&ht, dict_name))
     {
         ret_value = -1;
         goto fail_insert;
@@ -63,16 +104,21 @@ int main() {
 fail_insert:
     ht_Destructor(&ht);
 fail_constructor:
-    fclose(log_file);
+    logCloseFile(log_file);
 fail_logfile:
-    free(c_dict);
-fail_dict:
-    fclose(file);
+    if (c_dict) {
+        ftbUnmapFile(c_dict, dict_size);
+    }
+
+    if (file != stdin) {
+        fclose(file);
+    }
 fail_file:
     return ret_value;
 }
 
 
+// Every word of the file must be found. The timings are in lookup_bench.
 int TestLookUp(ht_HashTable* ht, const char* file_name) {
     if (!ht)
         return -1;
@@ -83,55 +129,134 @@ int TestLookUp(ht_HashTable* ht, const char* file_name) {
     }
 
     size_t lookup_size = 0;
-    char* c_lookup = (char*)ftbPutFileToBuffer(&lookup_size, lookup_file);
+    const char* c_lookup = ftbMapFile(&lookup_size, lookup_file, FTB_MAP_POPULATE);
+    fclose(lookup_file);
+
     if (c_lookup == nullptr) {
-        fclose(lookup_file);
         return -1;
     }
 
-    uint64_t start_time = __rdtsc();
+    size_t n_words = 0;
+    size_t n_found = 0;
 
-    for (int i = 0; i < 200000; i++) {
-        size_t cur_pos = 0;
-        while (cur_pos < lookup_size) {
-            const char* word = c_lookup + cur_pos;
-            size_t len = strlen(word);
+    const char* pos = c_lookup;
+    const char* word = nullptr;
+    size_t len = 0;
 
-            size_t value = 0;
-            //ht_LookUp(ht, word, len, &value);
-            HashCRC32_inline(word, len);
+    while ((word = ftbNextWord(&pos, c_lookup + lookup_size, &len))) {
+        size_t value = 0;
 
-            //fprintf(stderr, "word: %s (%lu)\n", word, value);
-
-            cur_pos += len + 1;
-        }
+        n_words++;
+        n_found += (ht_LookUp(ht, word, len, &value) == HT_ERR_NO);
     }
 
-    uint64_t end_time = __rdtsc();
+    fprintf(stderr, "Found %zu of %zu words\n", n_found, n_words);
 
-    fprintf(stderr, "Time taken: %lg\n", (double)(end_time - start_time)/1e10);
-    
-    fclose(lookup_file);
-    free(c_lookup);
+    ftbUnmapFile(c_lookup, lookup_size);
 
-    return 0;
+    return (n_found == n_words) ? 0 : -1;
 }
 
 
 
 int InsertDictionary(ht_HashTable* ht, const char* c_dict, size_t size) {
-    const char* str = c_dict;
+    int n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+
+    // Raw text is split into padded words right from the mapping.
+    if (gRawText) {
+        ftbWords words = {};
+        int ret_value = 0;
+
+        if (!ftbTokenize(&words, c_dict, size, FTB_TOKENIZE_CASE_FOLD) ||
+            ht_InsertParallel(ht, words.records, words.count * 16,
+                              gParallelInsert ? n_threads : 1)) {
+            ret_value = -1;
+        }
+
+        ftbFreeWords(&words);
+        return ret_value;
+    }
+
+    if (gParallelInsert) {
+        return ht_InsertTextParallel(ht, c_dict, size, n_threads) ? -1 : 0;
+    }
 
-    while (str < c_dict + size) {
-        size_t len = strlen(str);
+    const char* pos = c_dict;
+    const char* str = nullptr;
+    size_t len = 0;
 
+    while ((str = ftbNextWord(&pos, c_dict + size, &len))) {
         ht_Error err = ht_Insert(ht, str, len);
         if (err) {
             return -1;
         }
-
-        str += ht_gMaxWordLen;
     }
     
     return 0;
 }
+
+
+int LoadImage(ht_HashTable* ht, const char* image_name) {
+    FILE* image = fopen(image_name, "rb");
+    if (image == nullptr) {
+        return -1;
+    }
+
+    // The mapping outlives the file.
+    ht_Error err = ht_Load(ht, image, HashCRC32_inline);
+    fclose(image);
+
+    return err ? -1 : 0;
+}
+
+
+int SaveImage(ht_HashTable* ht, const char* image_name) {
+    FILE* image = fopen(image_name, "wb");
+    if (image == nullptr) {
+        return -1;
+    }
+
+    ht_Error err = ht_Save(ht, image);
+
+    if (fclose(image) != 0 || err) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// The reader thread fills the next chunk while this one is inserted.
+int InsertDictionaryStream(ht_HashTable* ht, FILE* file) {
+    ftbStream stream = {};
+    if (!ftbStreamOpen(&stream, file, FTB_DEFAULT_CHUNK_SIZE)) {
+        return -1;
+    }
+
+    int ret_value = 0;
+
+    const char* chunk = nullptr;
+    size_t chunk_size = 0;
+
+    while (ret_value == 0 && (chunk = ftbStreamNext(&stream, &chunk_size))) {
+        const char* pos = chunk;
+        const char* str = nullptr;
+        size_t len = 0;
+
+        while ((str = ftbNextWord(&pos, chunk + chunk_size, &len))) {
+            if (ht_Insert(ht, str, len)) {
+                ret_value = -1;
+                break;
+            }
+        }
+    }
+
+    if (!ftbStreamClose(&stream)) {
+        ret_value = -1;
+    }
+
+    return ret_value;
+}
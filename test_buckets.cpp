@@ -0,0 +1,279 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./hash_table/hash_table.h"
+#include "./hash_functions/hash_functions.h"
+
+// Randomized check of the List buckets in every way they can be ordered:
+// inserts, removes, lookups and batch lookups against plain counters, then
+// the bookkeeping of every bucket. isSorted and isLinear may be false when
+// the bucket happens to be in order, never true when it isn't, and sorted
+// buckets must really be sorted. The links must agree with each other and
+// with the size.
+//
+// The hash is cut to a few bits, so that the chains are long and keys with
+// equal full hashes are common. Every 7th key is too long to be inline.
+//
+// Usage: test_buckets [-s seed] [-n steps]
+
+const int    gNumKeys       = 20000;
+const int    gNumHotKeys    = 50;
+const int    gDefaultSteps  = 300000;
+const int    gCheckInterval = 50000;
+const size_t gBatchSize     = 64;
+
+enum Mode
+{
+    MODE_PLAIN,
+    MODE_SORTED,
+    MODE_SORTED_LATER,  // sorted halfway, so the unsorted buckets get sorted
+    MODE_MOVE_TO_FRONT,
+    MODE_TRANSPOSE,
+    MODE_REORDER_SORTED, // reorder turns the sorted buckets off
+    N_MODES,
+};
+
+const char* const gModeNames[N_MODES] = {"plain", "sorted", "sorted later", "move to front",
+                                         "transpose", "reorder sorted"};
+
+struct Keys {
+    char   strs[gNumKeys][48];
+    size_t lens[gNumKeys];
+    size_t counts[gNumKeys];
+};
+
+
+static uint64_t HashTruncated(const void* mem, size_t size) {
+    return HashCRC32_inline(mem, size) & 0xFFF0F;
+}
+
+
+static int GetRandomKey() {
+    int key = rand() % gNumKeys;
+
+    return (rand() % 2) ? key % gNumHotKeys : key;
+}
+
+
+static bool CheckList(const ht_HashTable* ht, const List* list) {
+    if (list->data == nullptr) {
+        return true;
+    }
+
+    bool is_sorted = true;
+    bool is_linear = true;
+    int  prev = -1;
+    int  size = 0;
+
+    for (int index = list->next[-1]; index != -1; index = list->next[index], size++) {
+        if (list->prev[index] != prev || size > list->listInfo.size) {
+            fprintf(stderr, "broken links\n");
+            return false;
+        }
+
+        if (prev != -1 && list->data[prev].hash > list->data[index].hash) {
+            is_sorted = false;
+        }
+
+        is_linear &= (index == size);
+        prev = index;
+    }
+
+    if (list->prev[-1] != prev || size != list->listInfo.size) {
+        fprintf(stderr, "tail or size is wrong\n");
+        return false;
+    }
+
+    if ((list->listInfo.isSorted && !is_sorted) || (list->listInfo.isLinear && !is_linear)) {
+        fprintf(stderr, "isSorted or isLinear is wrong\n");
+        return false;
+    }
+
+    if (ht->sorted_buckets && !is_sorted) {
+        fprintf(stderr, "unsorted bucket in a table with sorted buckets\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool CheckBuckets(const ht_HashTable* ht) {
+    for (size_t i = 0; i < ht->n_buckets; i++) {
+        if (!CheckList(ht, &ht->lists[i])) {
+            return false;
+        }
+    }
+
+    for (size_t i = ht->rehash_index; ht->old_lists && i < ht->old_n_buckets; i++) {
+        if (!CheckList(ht, &ht->old_lists[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool CheckBatch(ht_HashTable* ht, const Keys* keys) {
+    const char* strs  [gBatchSize] = {};
+    size_t      lens  [gBatchSize] = {};
+    size_t      values[gBatchSize] = {};
+    int         ids   [gBatchSize] = {};
+
+    for (size_t i = 0; i < gBatchSize; i++) {
+        ids[i]  = GetRandomKey();
+        strs[i] = keys->strs[ids[i]];
+        lens[i] = keys->lens[ids[i]];
+    }
+
+    if (ht_LookUpBatch(ht, strs, lens, gBatchSize, values)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < gBatchSize; i++) {
+        if (values[i] != keys->counts[ids[i]]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static int SetMode(ht_HashTable* ht, Mode mode) {
+    switch (mode) {
+        case MODE_SORTED:         return ht_SetSortedBuckets(ht, true);
+        case MODE_MOVE_TO_FRONT:  return ht_SetReorder(ht, HT_REORDER_MOVE_TO_FRONT);
+        case MODE_TRANSPOSE:      return ht_SetReorder(ht, HT_REORDER_TRANSPOSE);
+        case MODE_REORDER_SORTED: return ht_SetSortedBuckets(ht, true) ||
+                                         ht_SetReorder(ht, HT_REORDER_MOVE_TO_FRONT);
+        case MODE_PLAIN:
+        case MODE_SORTED_LATER:
+        case N_MODES:
+        default:                  return 0;
+    }
+}
+
+
+// Returns the step that failed, or -1.
+static int RunSteps(ht_HashTable* ht, Keys* keys, Mode mode, int n_steps) {
+    for (int step = 0; step < n_steps; step++) {
+        int key = GetRandomKey();
+        int op  = rand() % 20;
+
+        size_t value = 0;
+        ht_Error err = HT_ERR_NO;
+
+        if (op < 10) {
+            err = ht_Insert(ht, keys->strs[key], keys->lens[key]);
+            keys->counts[key]++;
+        } else if (op < 13) {
+            err = ht_Remove(ht, keys->strs[key], keys->lens[key]);
+
+            if ((err == HT_ERR_NO) != (keys->counts[key] != 0)) {
+                return step;
+            }
+
+            err = HT_ERR_NO;
+            keys->counts[key] = 0;
+        } else if (op < 19) {
+            err = ht_LookUp(ht, keys->strs[key], keys->lens[key], &value);
+            err = (err == HT_ERR_NO_SUCH_ELEMENT) ? HT_ERR_NO : err;
+
+            if (value != keys->counts[key]) {
+                return step;
+            }
+        } else if (!CheckBatch(ht, keys)) {
+            return step;
+        }
+
+        if (err) {
+            return step;
+        }
+
+        if (mode == MODE_SORTED_LATER && step == n_steps / 2 && ht_SetSortedBuckets(ht, true)) {
+            return step;
+        }
+
+        if (step % gCheckInterval == 0 && !CheckBuckets(ht)) {
+            return step;
+        }
+    }
+
+    return CheckBuckets(ht) ? -1 : n_steps;
+}
+
+
+static int TestMode(Keys* keys, Mode mode, int n_steps) {
+    memset(keys->counts, 0, sizeof(keys->counts));
+
+    ht_HashTable ht = {};
+    if (ht_Contructor(&ht, 64, HashTruncated)) {
+        return -1;
+    }
+
+    ht_SetMaxLoadFactor(&ht, 8.0f);
+
+    int failed_step = SetMode(&ht, mode) ? 0 : RunSteps(&ht, keys, mode, n_steps);
+
+    // Sorting everything at the end must keep all of it too.
+    if (failed_step == -1 && mode != MODE_PLAIN &&
+        (ht_SetSortedBuckets(&ht, true) || !CheckBuckets(&ht) || !CheckBatch(&ht, keys))) {
+        failed_step = n_steps;
+    }
+
+    if (failed_step != -1) {
+        fprintf(stderr, "%-15s failed at step %d\n", gModeNames[mode], failed_step);
+    } else {
+        printf("%-15s ok, %zu keys in %zu buckets\n", gModeNames[mode], ht.n_elems, ht.n_buckets);
+    }
+
+    ht_Destructor(&ht);
+
+    return (failed_step == -1) ? 0 : -1;
+}
+
+
+int main(int argc, char** argv) {
+    unsigned seed = 1;
+    int n_steps = gDefaultSteps;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "s:n:")) != -1; ) {
+        switch (opt) {
+            case 's': seed    = (unsigned) strtoul(optarg, nullptr, 10); break;
+            case 'n': n_steps = atoi(optarg);                            break;
+            default:
+                fprintf(stderr, "Usage: %s [-s seed] [-n steps]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    Keys* keys = (Keys*) calloc(1, sizeof(Keys));
+    if (keys == nullptr) {
+        return -1;
+    }
+
+    for (int i = 0; i < gNumKeys; i++) {
+        int len = snprintf(keys->strs[i], sizeof(keys->strs[i]),
+                           (i % 7 == 0) ? "a_rather_long_key_number_%d" : "k%d", i);
+        keys->lens[i] = (size_t) len;
+    }
+
+    int ret_value = 0;
+
+    for (int mode = 0; mode < N_MODES; mode++) {
+        srand(seed + (unsigned) mode);
+
+        if (TestMode(keys, (Mode) mode, n_steps)) {
+            ret_value = -1;
+        }
+    }
+
+    free(keys);
+
+    return ret_value;
+}
@@ -1,128 +1,410 @@
 #include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include "./bench_words.h"
+
+// Quality and speed of every function of gHashFunctions on the distinct
+// words of a dictionary:
+//   variance     of the bucket sizes, as in the README
+//   chi-square   of the bucket sizes against a uniform distribution,
+//                divided by its degrees of freedom: about 1 for a random function
+//   max chain    the biggest bucket
+//   bit bias     max |P(bit is 1) - 0.5| over the output bits
+//   avalanche    max |P(output bit flips) - 0.5| when one input bit flips
+//   cycles/key   rdtsc per hash, the best of gTimingRuns passes
+//
+// The quality tests run in parallel, a function per thread. The timing runs
+// afterwards on one thread, so that the functions don't share the core.
+//
+// Usage: test_hashes [-d dict] [-b n_buckets] [-t threads] [-p]
+//
+// -p also writes the bucket sizes to new_result<i>.txt for scripts/histogram.py.
+
+const char gDictName[] = "dict.txt";
+#define RESULT_NAME_MASK "new_result%d.txt"
 
-#include "./hash_table/hash_table.h"
-#include "./logs/logs.h"
-#include "./file_to_buffer/fileToBuffer.h"
-#include "./hash_functions/hash_functions.h"
+const size_t gDefaultBuckets = 997;
+const int    gDefaultThreads = 4;
+
+// Only the low 32 bits are tested: the CRC32 functions have no more, and
+// the bucket of a chained table is hash % n_buckets.
+const int    gOutputBits    = 32;
+const int    gInputBits     = ht_gMaxWordLen * 8;
+const size_t gAvalancheKeys = 4096;
+const int    gTimingRuns    = 5;
+
+// A function is good enough for the table if it spreads the words about as
+// well as a random one and uses all the output bits. The fastest of those
+// is recommended. Avalanche is only reported: CRC32 is linear and fails it
+// by design, yet spreads real words as well as any.
+const double gMaxChiSquare = 1.25;
+const double gMaxBitBias   = 0.05;
+
+struct Report {
+    const HashFunction* hash_function;
+    size_t n_buckets;
+    size_t* bucket_sizes;
+
+    double variance;
+    double chi_square;  // per degree of freedom
+    size_t max_chain;
+    double bit_bias;
+    double avalanche;
+    double cycles_per_key;
+};
+
+struct Worker {
+    const WordSet* keys;
+    Report* reports;
+    size_t n_reports;
+    size_t first;       // reports first, first + step, ...
+    size_t step;
+};
+
+
+inline static size_t GetLen(const char* word) {
+    return strnlen(word, ht_gMaxWordLen);
+}
 
 
-const char gLogFileName[] = "./build/log_file.html";
-const char gDictName[]    = "dict.txt";
-#define RESULT_NAME_MASK "new_result%d.txt"
+static void TestDistribution(const WordSet* keys, Report* report) {
+    uint64_t (*hash)(const void* mem, size_t size) = report->hash_function->hash_func;
+    size_t n_keys = keys->size / ht_gMaxWordLen;
 
+    size_t ones[gOutputBits] = {};
 
-int InsertDictionary (ht_HashTable* ht, const char* c_dict, size_t size);
-int GetResults       (ht_HashTable* ht, const char* hist_name);
-int TestHashFunctions(ht_HashTable* ht, const char* dict, size_t size,
-                      const HashFunction* hash_functions, size_t n_funcs);
+    for (size_t i = 0; i < n_keys; i++) {
+        const char* word = keys->words + i * ht_gMaxWordLen;
+        uint64_t value = hash(word, GetLen(word));
 
+        report->bucket_sizes[value % report->n_buckets]++;
 
-int main() {
-    FILE* log_file = nullptr;
-    int ret_value = 0;
-    size_t dict_size = 0;
-    char* c_dict = nullptr;
-    ht_HashTable ht = {};
-    ht_Error err = HT_ERR_NO;
+        for (int bit = 0; bit < gOutputBits; bit++) {
+            ones[bit] += (value >> bit) & 1;
+        }
+    }
 
-    FILE* file = fopen(gDictName, "r");
-    if (file == nullptr) {
-        ret_value = -1;
-        goto fail_file;
+    double expected = (double) n_keys / (double) report->n_buckets;
+    double sum_squares = 0;
+
+    for (size_t i = 0; i < report->n_buckets; i++) {
+        double diff = (double) report->bucket_sizes[i] - expected;
+        sum_squares += diff * diff;
+
+        if (report->bucket_sizes[i] > report->max_chain) {
+            report->max_chain = report->bucket_sizes[i];
+        }
+    }
+
+    report->variance = sum_squares / (double) report->n_buckets;
+
+    if (n_keys && report->n_buckets > 1) {
+        report->chi_square = sum_squares / expected / (double)(report->n_buckets - 1);
     }
 
-    c_dict = (char*) ftbTransferBufferTo16(&dict_size, file);
-    if (c_dict == nullptr) {
-        ret_value = -1;
-        goto fail_dict;
+    for (int bit = 0; bit < gOutputBits && n_keys; bit++) {
+        double bias = fabs((double) ones[bit] / (double) n_keys - 0.5);
+
+        if (bias > report->bit_bias) {
+            report->bit_bias = bias;
+        }
     }
+}
+
 
-    log_file = logOpenFile(gLogFileName);
-    if (log_file == nullptr) {
-        ret_value = -1;
-        goto fail_logfile;
+// Flips every bit of every sampled key, up to its length. Flipping may put
+// a zero inside a key, the length passed to the function stays the same.
+static int TestAvalanche(const WordSet* keys, Report* report) {
+    uint64_t (*hash)(const void* mem, size_t size) = report->hash_function->hash_func;
+    size_t n_keys = keys->size / ht_gMaxWordLen;
+    size_t stride = (n_keys + gAvalancheKeys - 1) / gAvalancheKeys;
+
+    size_t* flips  = (size_t*) calloc(gInputBits * gOutputBits, sizeof(size_t));
+    size_t* trials = (size_t*) calloc(gInputBits, sizeof(size_t));
+
+    if (flips == nullptr || trials == nullptr) {
+        free(flips);
+        free(trials);
+        return -1;
     }
 
-    ht_SetLogFile(log_file);
+    for (size_t i = 0; i < n_keys; i += stride ? stride : 1) {
+        char word[ht_gMaxWordLen] = {};
+        memcpy(word, keys->words + i * ht_gMaxWordLen, ht_gMaxWordLen);
 
-    TestHashFunctions(&ht, c_dict, dict_size, 
-              gHashFunctions, sizeof(gHashFunctions)/sizeof(gHashFunctions[0]));
+        size_t len = GetLen(word);
+        uint64_t value = hash(word, len);
 
-    fclose(log_file);
-fail_logfile:
-    free(c_dict);
-fail_dict:
-    fclose(file);
-fail_file:
-    return ret_value;
-}
+        for (size_t in_bit = 0; in_bit < len * 8; in_bit++) {
+            word[in_bit / 8] ^= (char)(1 << (in_bit % 8));
+            uint64_t diff = value ^ hash(word, len);
+            word[in_bit / 8] ^= (char)(1 << (in_bit % 8));
+
+            trials[in_bit]++;
+
+            for (int out_bit = 0; out_bit < gOutputBits; out_bit++) {
+                flips[in_bit * gOutputBits + out_bit] += (diff >> out_bit) & 1;
+            }
+        }
+    }
 
+    for (int in_bit = 0; in_bit < gInputBits; in_bit++) {
+        // Bits of the longest keys only, too few samples to tell.
+        if (trials[in_bit] < 64) {
+            continue;
+        }
 
-// TODO: add error check
-int TestHashFunctions(ht_HashTable* ht, const char* dict, size_t size,
-                      const HashFunction* hash_functions, size_t n_funcs) {
+        for (int out_bit = 0; out_bit < gOutputBits; out_bit++) {
+            double bias = fabs((double) flips[in_bit * gOutputBits + out_bit] /
+                               (double) trials[in_bit] - 0.5);
 
-    for (size_t i = 0; i < n_funcs; i++) {
-        ht_Contructor   (ht, 997, hash_functions[i].hash_func);
-        InsertDictionary(ht, dict, size);
-        GetResults      (ht, hash_functions[i].description);
-        ht_Destructor   (ht);
+            if (bias > report->avalanche) {
+                report->avalanche = bias;
+            }
+        }
     }
 
+    free(flips);
+    free(trials);
+
     return 0;
 }
 
 
-int InsertDictionary(ht_HashTable* ht, const char* c_dict, size_t size) {
-    const char* str = c_dict;
+static void* TestQuality(void* arg) {
+    Worker* worker = (Worker*) arg;
+
+    for (size_t i = worker->first; i < worker->n_reports; i += worker->step) {
+        TestDistribution(worker->keys, &worker->reports[i]);
+
+        if (TestAvalanche(worker->keys, &worker->reports[i])) {
+            return (void*) -1;
+        }
+    }
+
+    return nullptr;
+}
+
+
+static uint64_t TimeHash(const WordSet* keys, uint64_t (*hash)(const void* mem, size_t size)) {
+    size_t n_keys = keys->size / ht_gMaxWordLen;
+    uint64_t best = UINT64_MAX;
+
+    // Keeps the calls from being thrown away.
+    volatile uint64_t sink = 0;
+
+    for (int run = 0; run < gTimingRuns; run++) {
+        uint64_t sum = 0;
+        uint64_t start = __rdtsc();
+
+        for (size_t i = 0; i < n_keys; i++) {
+            const char* word = keys->words + i * ht_gMaxWordLen;
+            sum += hash(word, GetLen(word));
+        }
+
+        uint64_t cycles = __rdtsc() - start;
+        sink = sink + sum;
+
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+
+    return best;
+}
+
+
+static int RunTests(const WordSet* keys, Report* reports, size_t n_reports, int n_threads) {
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+    if ((size_t) n_threads > n_reports) {
+        n_threads = (int) n_reports;
+    }
+
+    pthread_t* threads = (pthread_t*) calloc((size_t) n_threads + 1, sizeof(pthread_t));
+    Worker*    workers = (Worker*)    calloc((size_t) n_threads + 1, sizeof(Worker));
+
+    if (threads == nullptr || workers == nullptr) {
+        free(threads);
+        free(workers);
+        return -1;
+    }
+
+    int ret_value = 0;
+    int n_started = 0;
+
+    for (; n_started < n_threads; n_started++) {
+        workers[n_started] = {
+            .keys      = keys,
+            .reports   = reports,
+            .n_reports = n_reports,
+            .first     = (size_t) n_started,
+            .step      = (size_t) n_threads,
+        };
+
+        if (pthread_create(&threads[n_started], nullptr, TestQuality, &workers[n_started])) {
+            ret_value = -1;
+            break;
+        }
+    }
 
-    while (str < c_dict + size) {
-        size_t len = strlen(str);
+    for (int i = 0; i < n_started; i++) {
+        void* result = nullptr;
+        pthread_join(threads[i], &result);
 
-        ht_Error err = ht_Insert(ht, str, len);
-        if (err) {
-            return -1;
+        if (result) {
+            ret_value = -1;
         }
+    }
+
+    free(threads);
+    free(workers);
+
+    if (ret_value) {
+        return ret_value;
+    }
 
-        str += ht_gMaxWordLen;
+    size_t n_keys = keys->size / ht_gMaxWordLen;
 
-        //ht_Dump_internal(ht);
+    for (size_t i = 0; i < n_reports && n_keys; i++) {
+        reports[i].cycles_per_key = (double) TimeHash(keys, reports[i].hash_function->hash_func) /
+                                    (double) n_keys;
     }
-    
+
     return 0;
 }
 
 
-int GetResults(ht_HashTable* ht, const char* hist_name) {
-    static int result_index = 0;
-    const size_t file_name_len = sizeof(RESULT_NAME_MASK) + 128;
-    const size_t command_len = 256;
+static const Report* ChooseBest(const Report* reports, size_t n_reports) {
+    const Report* best = nullptr;
+
+    for (size_t i = 0; i < n_reports; i++) {
+        const Report* report = &reports[i];
 
+        if (report->chi_square > gMaxChiSquare || report->bit_bias > gMaxBitBias) {
+            continue;
+        }
+
+        if (best == nullptr || report->cycles_per_key < best->cycles_per_key) {
+            best = report;
+        }
+    }
+
+    return best;
+}
+
+
+static int WriteBucketSizes(const Report* report, int index) {
+    const size_t file_name_len = sizeof(RESULT_NAME_MASK) + 16;
     char file_name[file_name_len] = {};
-    char command[command_len] = {};
 
-    snprintf(file_name, file_name_len, RESULT_NAME_MASK, result_index++);
+    snprintf(file_name, file_name_len, RESULT_NAME_MASK, index);
 
     FILE* file = fopen(file_name, "w");
     if (file == nullptr) {
         return -1;
     }
 
-    size_t size = ht->n_buckets;
+    for (size_t i = 0; i < report->n_buckets; i++) {
+        fprintf(file, "%zu %zu\n", i, report->bucket_sizes[i]);
+    }
+
+    return fclose(file) ? -1 : 0;
+}
+
+
+static void PrintReports(const Report* reports, size_t n_reports, size_t n_keys) {
+    printf("%zu keys, %zu buckets\n\n", n_keys, n_reports ? reports[0].n_buckets : 0);
+    printf("%-26s %12s %10s %9s %9s %9s %10s\n", "hash", "variance", "chi2/dof",
+           "max chain", "bit bias", "avalanche", "cycles/key");
+
+    for (size_t i = 0; i < n_reports; i++) {
+        const Report* r = &reports[i];
+
+        printf("%-26s %12.2f %10.3f %9zu %9.3f %9.3f %10.1f\n", r->hash_function->description,
+               r->variance, r->chi_square, r->max_chain, r->bit_bias, r->avalanche,
+               r->cycles_per_key);
+    }
+
+    const Report* best = ChooseBest(reports, n_reports);
+
+    if (best) {
+        printf("\nBest trade-off: %s, %.1f cycles/key\n",
+               best->hash_function->description, best->cycles_per_key);
+    } else {
+        printf("\nNo function spreads these keys evenly\n");
+    }
+}
+
+
+int main(int argc, char** argv) {
+    const char* dict_name = gDictName;
+    size_t n_buckets = gDefaultBuckets;
+    int n_threads = gDefaultThreads;
+    bool write_sizes = false;
+
+    for (int opt = 0; (opt = getopt(argc, argv, "d:b:t:p")) != -1; ) {
+        switch (opt) {
+            case 'd': dict_name   = optarg;                                  break;
+            case 'b': n_buckets   = (size_t) strtoull(optarg, nullptr, 10);  break;
+            case 't': n_threads   = atoi(optarg);                            break;
+            case 'p': write_sizes = true;                                    break;
+            default:
+                fprintf(stderr, "Usage: %s [-d dict] [-b n_buckets] [-t threads] [-p]\n",
+                        argv[0]);
+                return -1;
+        }
+    }
+
+    if (n_buckets == 0) {
+        n_buckets = gDefaultBuckets;
+    }
+
+    WordSet dict = {};
+    ReadWords(dict_name, &dict);
+
+    if (dict.words == nullptr) {
+        return -1;
+    }
+
+    const size_t n_reports = sizeof(gHashFunctions) / sizeof(gHashFunctions[0]);
+
+    Report  reports[n_reports] = {};
+    size_t* bucket_sizes = (size_t*) calloc(n_reports * n_buckets, sizeof(size_t));
 
-    for (int i = 0; i < size; i++) {
-        fprintf(file, "%d %d\n", i, ht->lists[i].listInfo.size);   
+    for (size_t i = 0; i < n_reports; i++) {
+        reports[i].hash_function = &gHashFunctions[i];
+        reports[i].n_buckets     = n_buckets;
+        reports[i].bucket_sizes  = bucket_sizes + i * n_buckets;
     }
 
-    fclose(file);
+    WordSet keys = {};
+    int ret_value = -1;
 
-    snprintf(command, command_len, "python3 scripts/histogram.py %s %s", file_name, hist_name);
-    system(command);
+    if (dict.words && bucket_sizes && !GetDistinctWords(&dict, &keys)) {
+        ret_value = RunTests(&keys, reports, n_reports, n_threads);
+    }
 
-    //snprintf(command, command_len, "rm %s", file_name);
-    //system(command);
+    if (ret_value == 0) {
+        PrintReports(reports, n_reports, keys.size / ht_gMaxWordLen);
 
-    return 0;
+        for (size_t i = 0; i < n_reports && write_sizes; i++) {
+            if (WriteBucketSizes(&reports[i], (int) i)) {
+                ret_value = -1;
+            }
+        }
+    }
+
+    free(keys.words);
+    free(bucket_sizes);
+    free(dict.words);
+
+    return ret_value;
 }